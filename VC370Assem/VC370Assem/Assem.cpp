@@ -7,6 +7,9 @@
 #include <stdio.h>
 
 #include "Assembler.h"
+#include "Incremental.h"
+#include "Server.h"
+#include "Verifier.h"
 
 void PressEnterToContinue() {
     cout << "____________________________________________" << endl << endl << endl;
@@ -17,8 +20,16 @@ void PressEnterToContinue() {
 
 int main( int argc, char *argv[] )
 {
+    Options options( argc, argv );
+
+    // The server and its client, the stress test and the watch mode do not use the interactive display.
+    if (options.IsServer()) return Server( options ).Run();
+    if (options.IsClient()) return RunClient( options );
+    if (options.GetStressPrograms() > 0) return VerifyEnginesOnRandomPrograms( options );
+    if (options.IsWatching()) return WatchSource( options );
+
     for (int i = 0; i < 10; ++i) cout << endl;
-    Assembler assem( argc, argv );
+    Assembler assem( options );
 
     // Establish the location of the labels:
     assem.PassI( );
@@ -33,10 +44,32 @@ int main( int argc, char *argv[] )
 
     PressEnterToContinue();
 
-    if (Errors::WasThereErrors()) { Errors::DisplayErrors(); exit(0); }
+    if (Errors::WasThereErrors()) { assem.WriteStats(); Errors::DisplayErrors(); exit(0); }
+
+    if (options.GetPartialEvalSteps() > 0) {
+        assem.PartiallyEvaluate(options.GetPartialEvalSteps());
+        PressEnterToContinue();
+    }
+    if (options.IsOptimizing()) {
+        assem.Optimize();
+        PressEnterToContinue();
+    }
+    if (!options.GetProfileUse().empty()) {
+        assem.LayOutByProfile(options.GetProfileUse());
+        PressEnterToContinue();
+    }
+
+    // Debug the translation, or compare the engines on it, instead of running it normally.
+    if (options.IsDebugging()) { assem.Debug( options.GetLimits() ); return 0; }
+    if (!options.GetVerifyEngines().empty()) return assem.VerifyEngines( options ) ? 0 : 1;
+
     // Run the emulator on the Quack3200 program that was generated in Pass II.
     assem.RunProgramInEmulator();
+    assem.WriteStats();
 
+    // A watchdog stop gets its own exit status so that a scheduler can tell it from a normal run.
+    RunStatus status = assem.GetRunStatus();
+    if (status == RS_StepLimit || status == RS_TimeLimit) { Errors::DisplayErrors(); exit(2); }
     if (Errors::WasThereErrors()) { Errors::DisplayErrors(); exit(0); }
    
     // Terminate indicating all is well.  If there is an unrecoverable error, the 
@@ -3,7 +3,14 @@
 //
 #include "stdafx.h"
 #include "Assembler.h"
+#include "AsyncEmulator.h"
+#include "Debugger.h"
 #include "Errors.h"
+#include "Layout.h"
+#include "Optimizer.h"
+#include "PartialEvaluator.h"
+#include "Verifier.h"
+#include <iomanip>
 #include <iostream>
 #include <limits>
 #include <unordered_map>
@@ -11,12 +18,60 @@
 vector<string> Errors::m_ErrorMsgs;
 bool Errors::m_WasErrorMessages = false;
 
-// Constructor for the assembler.  Note: we are passing argc and argv to the file access constructor.
-// See main program.  
-Assembler::Assembler( int argc, char *argv[] )
-	: m_facc(argc, argv)
+// Constructor for the assembler.  Opens the source file and configures the emulator
+// watchdog from the command line options.  See main program.
+Assembler::Assembler( const Options &a_options )
+	: m_facc(a_options.GetSourceFile()), m_pagedEmul(a_options.GetMemorySize()), m_memorySize(a_options.GetMemorySize()),
+	  m_harts(a_options.GetHarts()), m_deterministic(a_options.IsDeterministic()), m_limits(a_options.GetLimits()),
+	  m_listing(cout), m_async(a_options.IsAsync()), m_haveInputs(a_options.HasInputs()), m_inputs(a_options.GetInputs())
 {
-    // Nothing else to do here at this point.
+    m_emul.SetLimits(a_options.GetLimits());
+    m_emul.EnableFastForward(a_options.IsFastForwarding());
+    m_pagedEmul.SetLimits(a_options.GetLimits());
+    m_inst.SetExtended(a_options.IsExtended());
+    m_emul.EnableExtended(a_options.IsExtended());
+    m_pagedEmul.EnableExtended(a_options.IsExtended());
+    m_profileOut = a_options.GetProfileOut();
+    m_emul.EnableProfile(!m_profileOut.empty());
+    if (a_options.WantsStats()) {
+        m_stats.reset(new Stats(a_options.GetStatsOut()));
+        m_stats->SetProgram(a_options.GetSourceFile());
+        CycleModel model;
+        string error;
+        if (!a_options.GetCycleModel().empty() && !model.Read(a_options.GetCycleModel(), error)) {
+            m_listing << "[Stats] " << error << "; the default cycle model is used." << endl;
+        }
+        m_stats->SetCycleModel(model);
+        m_emul.EnableOpcodeCounts(true);
+        m_pagedEmul.EnableOpcodeCounts(true);
+    }
+    // A profile or the statistics need a run that was emulated rather than replayed.
+    if (a_options.UseRunCache() && m_profileOut.empty() && !m_stats) {
+        m_runCache.reset(new RunCache(size_t(a_options.GetRunCacheSize()), a_options.GetRunCacheDir()));
+    }
+}
+
+// Constructor used by AssembleText.
+Assembler::Assembler( const string &a_sourceText, ostream &a_listing )
+	: m_facc(a_sourceText, FileAccess::SK_Text), m_memorySize(VC370Constants::kMaxMemory), m_harts(0), m_deterministic(false), m_listing(a_listing),
+	  m_async(false), m_haveInputs(false)
+{
+}
+
+// Assembles source text quietly, for callers such as the server that keep the image.
+bool Assembler::AssembleText( const string &a_source, ProgramImage &a_image, vector<string> &a_errors )
+{
+    ostream quiet(nullptr);     // Discards the translation listing.
+    Assembler assem(a_source, quiet);
+
+    Errors::InitErrorReporting();
+    assem.PassI();
+    assem.PassII();
+    a_errors = Errors::GetErrors();
+    Errors::InitErrorReporting();
+
+    a_image = assem.m_image;
+    return a_errors.empty();
 }
 // Destructor currently does nothing.  You might need to add something as you develope this project.
 Assembler::~Assembler( )
@@ -28,6 +83,7 @@ void Assembler::PassI( )
 
 
     int loc = 0;        // Tracks the location of the instructions to be generated.
+    Stats::Phase phase(m_stats.get(), "PassI");
 
     // Successively process each line of source code.
     while( true ) {
@@ -61,11 +117,13 @@ void Assembler::PassI( )
 			} else {
 				m_symtab.AddSymbol( m_inst.GetLabel( ), loc );
 			}
+			if (m_inst.GetOpCode() == "BUF") m_buffers.insert(m_inst.GetLabel());
         }
 
         // Compute the location of the next instruction.
         loc = m_inst.LocationNextInstruction( loc );
     }
+    phase.End();
     ErrorDection();
 
 }
@@ -74,11 +132,10 @@ void Assembler::PassI( )
 void Assembler::ErrorDection()
 {
     int loc = 0;
+    Stats::Phase phase(m_stats.get(), "ErrorDection");
 
     m_facc.rewind();
 
-    unordered_map<string, int> labelDefinitions;
-
     while (true) {
         string line;
         if (!m_facc.GetNextLine(line)) {
@@ -91,59 +148,91 @@ void Assembler::ErrorDection()
         if (st == Instruction::ST_End)  break; 
 		if (st == Instruction::ST_Comment) continue;
 
-		string label = m_inst.GetLabel();
-		string operand = m_inst.GetOperand();
-		string opcode = m_inst.GetOpCode();
+		CheckStatement(m_inst, m_symtab, m_buffers, m_memorySize);
 
-
-		// Check for invalid label format.
-		if (!operand.empty() && !m_inst.isNumericOperand()) {
-			if (!m_symtab.LookupSymbol(operand, loc)) {
-				Errors::RecordError("Undefined label: " + operand);
-			}
+		// Insufficient memory detection.
+		if (loc >= m_memorySize) {
+			Errors::RecordError("[Error Dec] Insufficient memory for the translation at location " + to_string(loc));
 		}
 
-		// Check for invalid opcode.
-		if (!Instruction::IsValidOpcode(opcode)) {
-			Errors::RecordError("Illegal opcode: " + opcode);
-		}
+        loc = m_inst.LocationNextInstruction( loc );
+    }
+}
 
-        
-		// Operand checks for specific opcodes.
-		if (opcode == "READ" || opcode == "WRITE" || opcode == "LOAD" || opcode == "STORE") {
-			if (operand.empty()) {
-				Errors::RecordError("[Error Dec] Missing operand for " + opcode);
-			}
-		} else if (opcode == "DC" || opcode == "DS") {
-			if (!m_inst.isNumericOperand()) {
-				Errors::RecordError("[Error Dec] Non-numeric operand for " + opcode);
-			}
-		}
+/*
+NAME
 
-	   // Constant too large detection.
-		if (opcode == "DC" && m_inst.isNumericOperand()) {
-			int value = stoi(operand);
-			if (value > SymbolTable::MAX_MEMORY) {
-				Errors::RecordError("[Error Dec] Constant too large for VC370 memory: " + operand);
-			}
-		}
+    CheckStatement - checks a statement against the symbols of the program.
 
-		// Insufficient memory detection.
-		if (loc >= SymbolTable::MAX_MEMORY) {
-			Errors::RecordError("[Error Dec] Insufficient memory for the translation at location " + to_string(loc));
-		}
+SYNOPSIS
 
-		// Check for invalid label format.
-		if (!IsValidLabel(label)) {
-			Errors::RecordError("[Error Dec] Invalid label format '" + label + "'.");
-		}
+    static void CheckStatement( Instruction &a_inst, SymbolTable &a_symtab, const set<string> &a_buffers, int a_memorySize );
 
-        loc = m_inst.LocationNextInstruction( loc );
+DESCRIPTION
+
+    Records the errors of the statement just parsed by a_inst, other than those of its
+    location.  The incremental assembler of --watch checks the statements it parses
+    again with this, so that it reports the same errors as ErrorDection.
+*/
+void Assembler::CheckStatement( Instruction &a_inst, SymbolTable &a_symtab, const set<string> &a_buffers, int a_memorySize )
+{
+    string label = a_inst.GetLabel();
+    string operand = a_inst.GetOperand();
+    string opcode = a_inst.GetOpCode();
+
+    // Check for an undefined label.
+    if (!operand.empty() && !a_inst.isNumericOperand()) {
+        int address;
+        if (!a_symtab.LookupSymbol(operand, address)) {
+            Errors::RecordError("Undefined label: " + operand);
+        }
+    }
+
+    // Check for invalid opcode.
+    if (!Instruction::IsValidOpcode(opcode)) {
+        Errors::RecordError("Illegal opcode: " + opcode);
+    }
+
+    // Operand checks for specific opcodes.
+    if (opcode == "READ" || opcode == "WRITE" || opcode == "LOAD" || opcode == "STORE") {
+        if (operand.empty()) {
+            Errors::RecordError("[Error Dec] Missing operand for " + opcode);
+        }
+    } else if (opcode == "DC" || opcode == "DS" || opcode == "BUF") {
+        if (!a_inst.isNumericOperand()) {
+            Errors::RecordError("[Error Dec] Non-numeric operand for " + opcode);
+        }
+    } else if (Instruction::IsExtendedOpcode(opcode)) {
+        // The extended instructions other than JOIN take an address, or a count for SETX
+        // and INCX, which must fit in the address field.
+        if (operand.empty() && opcode != "JOIN") {
+            Errors::RecordError("[Error Dec] Missing operand for " + opcode);
+        } else if (a_inst.isNumericOperand() && a_inst.GetOperandValue() >= a_memorySize) {
+            Errors::RecordError("[Error Dec] Operand too large for VC370 memory: " + opcode + " " + operand);
+        } else if ((opcode == "BREAD" || opcode == "BWRITE") && !a_inst.isNumericOperand() && a_buffers.count(operand) == 0) {
+            Errors::RecordError("[Error Dec] Operand of " + opcode + " is not a BUF buffer: " + operand);
+        }
+    }
+
+    // Constant too large detection.
+    if (opcode == "DC" && a_inst.isNumericOperand()) {
+        int value = stoi(operand);
+        if (value > a_memorySize) {
+            Errors::RecordError("[Error Dec] Constant too large for VC370 memory: " + operand);
+        }
     }
-}
 
+    // Check for invalid label format.
+    if (!IsValidLabel(label, a_inst.IsExtended())) {
+        Errors::RecordError("[Error Dec] Invalid label format '" + label + "'.");
+    }
+}
 
 bool Assembler::IsValidLabel(string& label) {
+	return IsValidLabel(label, m_inst.IsExtended());
+}
+
+bool Assembler::IsValidLabel(string& label, bool a_extended) {
 	if (label.empty()) return true;
 
     // Check if the label length is within acceptable bounds (e.g., 1-10 characters).
@@ -165,7 +254,7 @@ bool Assembler::IsValidLabel(string& label) {
     }
 
     // Check if the label matches any reserved keywords or opcodes.
-    if (Instruction::IsReservedKeyword(label)) {
+    if (Instruction::IsReservedKeyword(label, a_extended)) {
         Errors::RecordError("[Lab Val] Label matches a reserved keyword or opcode.");
         return false;
     }
@@ -176,12 +265,16 @@ bool Assembler::IsValidLabel(string& label) {
 void Assembler::PassII()
 {
      int loc = 0; // Tracks the memory location of instructions.
+     Stats::Phase phase(m_stats.get(), "PassII");
 
     // Rewind the file to process it again.
      m_facc.rewind();
 
-    cout << "Translation of Program:" << endl;
-	cout << "Location" << "\t" << "Contents" << "\t" << "Original Statement" << endl;
+     m_image = ProgramImage();
+     m_image.SetMemorySize(m_memorySize);
+
+    m_listing << "Translation of Program:" << endl;
+	m_listing << "Location" << "\t" << "Contents" << "\t" << "Original Statement" << endl;
 
     // Successively process each line of source code.
     while( true ) {
@@ -200,7 +293,7 @@ void Assembler::PassII()
         // If this is an end statement, there is nothing left to do in pass I.
         // Pass II will determine if the end is the last statement.
         if (st == Instruction::ST_End) {
-	        cout << "\t\t" << "" << "\t\t" << line << endl;
+	        m_listing << "\t\t" << "" << "\t\t" << line << endl;
             break;
         }
 
@@ -209,18 +302,313 @@ void Assembler::PassII()
         // instructions.  So, skip other instruction types. We can do better/
         if( st != Instruction::ST_MachineLanguage && st != Instruction::ST_AssemblerInstr ) 
         {
-	        cout << "\t\t" << "" << "\t\t" << line << endl;
+	        m_listing << "\t\t" << "" << "\t\t" << line << endl;
         	continue;
 		}
 
         // Compute the location of the next instruction.
-		string contents = m_inst.GenerateMachineCode(m_symtab);
-	    cout << loc << "\t\t" << contents << "\t\t" << line << endl;
-		m_emul.insertMemory(loc, contents.empty() ? 0 : stoi(contents));
+		string contents = m_inst.GenerateMachineCode(m_symtab, m_memorySize);
+	    m_listing << loc << "\t\t" << contents << "\t\t" << line << endl;
+		m_image.AddWord(loc, contents.empty() ? 0 : stoi(contents));
+		RecordStatement(loc, line);
         loc = m_inst.LocationNextInstruction( loc );
     }
+    m_image.SetSymbols(m_symtab.GetSymbols());
+
+}
 
 
+
+// Records what the statement just translated put in memory, for the optimizer.
+void Assembler::RecordStatement( int a_loc, const string &a_line )
+{
+    const string &opcode = m_inst.GetOpCode();
+    if (m_inst.GetType() == Instruction::ST_MachineLanguage) {
+        m_image.AddStatement(ProgramImage::SK_Instruction, a_loc, 1, a_line);
+    } else if (opcode == "DC") {
+        m_image.AddStatement(ProgramImage::SK_Constant, a_loc, 1, a_line);
+    } else if ((opcode == "DS" || opcode == "BUF") && m_inst.GetOperandValue() > 0) {
+        m_image.AddStatement(ProgramImage::SK_Storage, a_loc, m_inst.GetOperandValue(), a_line);
+    }
 }
 
+// Runs the input independent start of the program now.  If that cannot be done, the
+// translation is kept.
+void Assembler::PartiallyEvaluate( long long a_maxSteps )
+{
+    Stats::Phase phase(m_stats.get(), "PartiallyEvaluate");
+    PartialEvaluator evaluator(a_maxSteps);
+    ProgramImage evaluated;
+    if (!evaluator.Evaluate(m_image, evaluated)) {
+        m_listing << "[Partial evaluation] Program not evaluated: " << evaluator.GetRefusal() << "." << endl;
+        return;
+    }
+    m_image = evaluated;
+    DisplayTranslation("Partially Evaluated Translation of Program:");
+    evaluator.DisplayReport(m_listing);
+}
 
+// Optimizes the translation.  A program the optimizer refuses runs as it was written.
+void Assembler::Optimize()
+{
+    Stats::Phase phase(m_stats.get(), "Optimize");
+    Optimizer optimizer;
+    ProgramImage optimized;
+    if (!optimizer.Optimize(m_image, optimized)) {
+        m_listing << "[Optimizer] Program not optimized: " << optimizer.GetRefusal() << "." << endl;
+        return;
+    }
+    m_image = optimized;
+    DisplayTranslation("Optimized Translation of Program:");
+    optimizer.DisplayReport(m_listing);
+}
+
+// Lays the translation out by a profile from an earlier run of it.  If that cannot be
+// done, the translation is kept.
+void Assembler::LayOutByProfile( const string &a_path )
+{
+    Stats::Phase phase(m_stats.get(), "LayOutByProfile");
+    ExecutionProfile profile;
+    string error;
+    if (!profile.Read(a_path, error)) {
+        m_listing << "[Profile] " << error << "; layout unchanged." << endl;
+        return;
+    }
+    BlockLayout layout;
+    ProgramImage laidOut;
+    if (!layout.Arrange(m_image, profile, laidOut)) {
+        m_listing << "[Profile] Layout unchanged: " << layout.GetRefusal() << "." << endl;
+        return;
+    }
+    m_image = laidOut;
+    DisplayTranslation("Translation Laid Out by Profile:");
+    layout.DisplayReport(m_listing);
+}
+
+void Assembler::DisplayTranslation( const string &a_title )
+{
+    m_listing << a_title << endl;
+    m_listing << "Location" << "\t" << "Contents" << "\t" << "Original Statement" << endl;
+    for (const ProgramImage::Statement &statement : m_image.GetStatements()) {
+        m_listing << statement.m_loc << "\t\t";
+        if (statement.m_kind == ProgramImage::SK_Storage) {
+            m_listing << "\t";
+        } else {
+            int contents = 0;
+            for (const ProgramImage::Word &word : m_image.GetWords()) {
+                if (word.m_loc == statement.m_loc) contents = word.m_contents;
+            }
+            m_listing << setw(2 + VC370Constants::AddressDigits(m_image.GetMemorySize())) << setfill('0') << contents << setfill(' ') << "\t";
+        }
+        m_listing << "\t" << statement.m_source << endl;
+    }
+    m_listing << "Execution starts at location " << m_image.GetStart() << "." << endl << endl;
+}
+
+// The profile is tied to the translation by its hash, so that it is only used with it.
+void Assembler::WriteProfile()
+{
+    ExecutionProfile profile;
+    profile.m_imageHash = m_image.Hash();
+    profile.m_counts = m_emul.GetExecutionCounts();
+    profile.m_taken = m_emul.GetTakenCounts();
+    string error;
+    if (!profile.Write(m_profileOut, error)) Errors::RecordError("[Profile] " + error);
+}
+
+// The debugger reads its commands from cin, as the emulation would read its input.
+void Assembler::Debug( const RunLimits &a_limits )
+{
+    Debugger debugger(m_image, a_limits, m_inst.IsExtended(), m_haveInputs, m_inputs);
+    debugger.Run(cin, cout);
+}
+
+/*
+NAME
+
+    VerifyEngines - runs the translation with each engine and the reference engine.
+
+SYNOPSIS
+
+    bool VerifyEngines( const Options &a_options );
+
+DESCRIPTION
+
+    Used by --verify-engines instead of running the translation normally.  The inputs
+    are those given by --inputs, and READs past them leave memory unchanged.
+*/
+bool Assembler::VerifyEngines( const Options &a_options )
+{
+    bool agree = true;
+    for (const string &engine : a_options.GetVerifyEngines()) {
+        EngineVerifier verifier(engine, a_options.GetVerifyInterval(), a_options.GetLimits(), a_options.IsExtended());
+        if (verifier.Verify(m_image, m_inputs)) {
+            cout << "[Verify] The reference and " << engine << " engines agree on " << verifier.GetSteps()
+                 << " instructions (" << verifier.GetComparisons() << " comparisons)." << endl;
+        } else {
+            cout << "[Verify] The reference and " << engine << " engines disagree." << endl;
+            verifier.DisplayMismatch(cout);
+            agree = false;
+        }
+    }
+    return agree;
+}
+
+// Runs the emulator on the translation, either directly or as a coroutine session.  The
+// classic memory keeps its own emulator, which does not pay for paging.
+void Assembler::RunProgramInEmulator()
+{
+    Stats::Phase phase(m_stats.get(), "Emulation");
+    if (m_harts > 0) {
+        RunProgramOnHarts();
+    } else if (IsWide()) {
+        RunProgram(m_pagedEmul);
+        RecordEmulation(m_pagedEmul);
+    } else {
+        RunProgram(m_emul);
+        phase.End();
+        RecordEmulation(m_emul);
+        if (m_emul.IsProfiling()) WriteProfile();
+    }
+}
+
+// A run replayed by the run cache is not recorded, but the cache is off with --stats.
+template <typename t_Emulator> void Assembler::RecordEmulation( const t_Emulator &a_emul )
+{
+    if (!m_stats) return;
+    m_stats->SetEmulation(a_emul.GetStatus(), a_emul.GetStepCount(), a_emul.GetFastForwardSteps(), a_emul.GetIoWaitMicros(),
+                          1, a_emul.GetOpcodeCounts());
+}
+
+// The statistics are written after the run, or after the assembly if it has errors.
+void Assembler::WriteStats()
+{
+    if (!m_stats) return;
+    string error;
+    if (!m_stats->Write(error)) cerr << "[Stats] " << error << endl;
+}
+
+template <typename t_Emulator> void Assembler::RunProgram( t_Emulator &a_emul )
+{
+    if (!a_emul.LoadImage(m_image)) return;
+    if (m_haveInputs) {
+        RunProgramOnInputs(a_emul);
+    } else if (m_async) {
+        RunProgramInScheduler(a_emul);
+    } else {
+        a_emul.runProgram();
+    }
+}
+
+// Runs the translation on the command line inputs, displaying the output without prompts
+// as it is written.  With the run cache the result of an earlier run on the same inputs
+// is replayed.
+template <typename t_Emulator> void Assembler::RunProgramOnInputs( t_Emulator &a_emul )
+{
+    const size_t kMaxCachedOutputs = 1 << 20;   // Values kept for the run cache.
+
+    cout << "Start of emulation." << endl;
+    RunResult result;
+    uint64_t key = 0;
+    bool replayed = false;
+    if (m_runCache) {
+        key = RunCache::Key(m_image, m_inputs, m_limits, m_inst.IsExtended());
+        replayed = m_runCache->Find(key, result);
+    }
+    bool keeping = m_runCache != nullptr;
+    if (replayed) {
+        WriteWords(cout, result.m_outputs.data(), result.m_outputs.size());
+    } else {
+        // The values are displayed as they are written and only kept for the run cache,
+        // so that a program writing without end neither stays silent nor runs out of memory.
+        result.m_status = a_emul.StreamBatch(m_inputs, [&]( const int *a_values, size_t a_count ) {
+            WriteWords(cout, a_values, a_count);
+            if (!keeping) return;
+            if (result.m_outputs.size() + a_count > kMaxCachedOutputs) {
+                keeping = false;
+                vector<int>().swap(result.m_outputs);
+                return;
+            }
+            result.m_outputs.insert(result.m_outputs.end(), a_values, a_values + a_count);
+        });
+        result.m_steps = a_emul.GetStepCount();
+        result.m_message = a_emul.GetErrorMessage();
+    }
+
+    if (result.m_status == RS_Halted) {
+        cout << "End of emulation." << endl;
+    } else {
+        Errors::RecordError(result.m_message);
+    }
+    if (!replayed && a_emul.GetFastForwardSteps() > 0) {
+        cout << "[Fast forward] " << a_emul.GetFastForwardSteps() << " of " << result.m_steps
+             << " instructions were run by fast forwarding counted loops." << endl;
+    }
+
+    if (!m_runCache) return;
+    if (replayed) {
+        cout << "[Run cache] Result replayed without emulation (" << result.m_steps << " instructions)." << endl;
+    } else if (!a_emul.IsCacheable()) {
+        cout << "[Run cache] Result not cached: the run was stopped by a limit." << endl;
+    } else if (!keeping) {
+        cout << "[Run cache] Result not cached: the run wrote more than " << kMaxCachedOutputs << " values." << endl;
+    } else {
+        m_runCache->Insert(key, result);
+    }
+}
+
+// Runs the translation on the harts, from the command line inputs or the terminal.
+void Assembler::RunProgramOnHarts()
+{
+    m_multiprocessor.reset(new Multiprocessor(m_memorySize, m_harts, m_deterministic));
+    m_multiprocessor->EnableExtended(m_inst.IsExtended());
+    m_multiprocessor->SetLimits(m_limits);
+    m_multiprocessor->EnableOpcodeCounts(m_stats != nullptr);
+    if (!m_multiprocessor->LoadImage(m_image)) return;
+    if (m_haveInputs) {
+        cout << "Start of emulation." << endl;
+        RunStatus status = m_multiprocessor->RunBatch(m_inputs);
+        if (status == RS_Halted) {
+            cout << "End of emulation." << endl;
+        } else {
+            Errors::RecordError(m_multiprocessor->GetErrorMessage());
+        }
+    } else {
+        m_multiprocessor->runProgram();
+    }
+    cout << "[Harts] " << m_multiprocessor->GetHartCount() << " harts retired " << m_multiprocessor->GetStepCount()
+         << " instructions" << (m_deterministic ? " in turn on one thread." : ", each on its own thread.") << endl;
+    if (m_stats) {
+        m_stats->SetEmulation(m_multiprocessor->GetStatus(), m_multiprocessor->GetStepCount(), 0, 0,
+                              m_multiprocessor->GetHartCount(), m_multiprocessor->GetOpcodeCounts());
+    }
+}
+
+// Runs the translation as a single session of the coroutine scheduler.  Input is only
+// read from cin when the session is suspended waiting for it.
+template <typename t_Emulator> void Assembler::RunProgramInScheduler( t_Emulator &a_emul )
+{
+    const long long kSlice = 100'000;   // Instructions a session runs before yielding.
+
+    cout << "Start of emulation." << endl;
+    SessionScheduler sched;
+    InputQueue input;
+    a_emul.SetSlice(kSlice);
+    size_t id = sched.Spawn(RunProgramAsync(a_emul, input), [](int a_value) { cout << a_value << endl; });
+    while (true) {
+        sched.Run();
+        if (sched.IsFinished(id)) break;
+
+        // The session is waiting for input.
+        cout << "? ";
+        int value;
+        if (cin >> value) input.Push(value);
+        else input.Close();
+    }
+    a_emul.SetSlice(0);
+    if (a_emul.GetStatus() == RS_Halted) {
+        cout << "End of emulation." << endl;
+    } else {
+        Errors::RecordError(a_emul.GetErrorMessage());
+    }
+}
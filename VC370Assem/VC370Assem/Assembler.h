@@ -8,20 +8,34 @@
 #include "Instruction.h"
 #include "FileAccess.h"
 #include "Emulator.h"
+#include "Multiprocessor.h"
+#include "Options.h"
+#include "ProgramImage.h"
+#include "RunCache.h"
+#include "Stats.h"
+#include <memory>
 
 
 class Assembler {
 
 public:
-    Assembler(int argc, char* argv[]);
+    Assembler(const Options &a_options);
     ~Assembler();
 
+    // Assembles source text without displaying anything.  Returns false and sets a_errors
+    // if there were errors.  Uses the global error reporting, so calls must not overlap.
+    static bool AssembleText(const string &a_source, ProgramImage &a_image, vector<string> &a_errors);
+
     // Pass I - establish the locations of the symbols
     void PassI();
 
     void ErrorDection();
 
     bool IsValidLabel(string& label);
+    static bool IsValidLabel(string& label, bool a_extended);
+
+    // Records the errors of the statement parsed by a_inst that do not depend on its location.
+    static void CheckStatement(Instruction &a_inst, SymbolTable &a_symtab, const set<string> &a_buffers, int a_memorySize);
 
         // Pass II - generate a translation
         void PassII();
@@ -30,13 +44,89 @@ public:
         void DisplaySymbolTable() { m_symtab.DisplaySymbolTable(); }
 
         // Run emulator on the translation.
-        void RunProgramInEmulator() { m_emul.runProgram(); }
+        void RunProgramInEmulator();
+
+        // Replaces the translation with one that starts where the part before the first
+        // READ ends, running at most a_maxSteps instructions to get there.
+        void PartiallyEvaluate(long long a_maxSteps);
+
+        // Replaces the translation with its optimized version, displaying the result.
+        void Optimize();
+
+        // Replaces the translation with its layout by the profile in a file.
+        void LayOutByProfile(const string &a_path);
+
+        // Runs the translation under the interactive debugger instead of running it normally.
+        void Debug(const RunLimits &a_limits);
+
+        // Runs the translation with the engines named by the options and the reference
+        // engine side by side instead of running it normally.  Returns false if they disagree.
+        bool VerifyEngines(const Options &a_options);
+
+        // Writes the statistics asked for by --stats, if any.
+        void WriteStats();
+
+        // The outcome of the last emulation.
+        RunStatus GetRunStatus() const
+        {
+            if (m_multiprocessor) return m_multiprocessor->GetStatus();
+            return IsWide() ? m_pagedEmul.GetStatus() : m_emul.GetStatus();
+        }
+
+        // The translation produced by Pass II.
+        const ProgramImage &GetImage() const { return m_image; }
 
 
 private:
 
+    // Assembles source text, sending the translation listing to a_listing.
+    Assembler(const string &a_sourceText, ostream &a_listing);
+
+    // Displays a translation that replaced the original one.
+    void DisplayTranslation(const string &a_title);
+
+    // Writes the execution profile of the last run.
+    void WriteProfile();
+
+    // Records what the statement just translated put in memory.
+    void RecordStatement(int a_loc, const string &a_line);
+
+    // Whether the translation is for a memory larger than the classic one, and so runs
+    // on the paged emulator.
+    bool IsWide() const { return m_memorySize != VC370Constants::kMaxMemory; }
+
+    // Runs the translation on a_emul, which is m_emul or m_pagedEmul.
+    template <typename t_Emulator> void RunProgram(t_Emulator &a_emul);
+
+    // Runs the translation as a coroutine session fed from cin.
+    template <typename t_Emulator> void RunProgramInScheduler(t_Emulator &a_emul);
+
+    // Runs the translation on the inputs given on the command line.
+    template <typename t_Emulator> void RunProgramOnInputs(t_Emulator &a_emul);
+
+    // Runs the translation on the multiprocessor selected by --harts.
+    void RunProgramOnHarts();
+
+    // Records what the last run on a_emul did in the statistics.
+    template <typename t_Emulator> void RecordEmulation(const t_Emulator &a_emul);
+
     FileAccess m_facc;	    // File Access object
     SymbolTable m_symtab;	// Symbol table object
     Instruction m_inst;	    // Instruction object
     emulator m_emul;        // Emulator object
+    PagedEmulator m_pagedEmul;  // Emulator of a memory selected by --memory.
+    int m_memorySize;       // Words of memory the translation is for.
+    int m_harts;            // Harts of the multiprocessor, or zero to run on a single emulator.
+    bool m_deterministic;   // The harts take turns on one thread.
+    RunLimits m_limits;     // Watchdog limits of the harts.
+    unique_ptr<Multiprocessor> m_multiprocessor;    // The multiprocessor of the last run, if any.
+    set<string> m_buffers;  // Labels of the BUF directives.
+    ProgramImage m_image;   // The translation.
+    ostream &m_listing;     // Where Pass II displays the translation.
+    bool m_async;           // Run the emulator through the coroutine front end.
+    bool m_haveInputs;      // Inputs were given on the command line.
+    vector<int> m_inputs;   // The inputs given on the command line.
+    unique_ptr<RunCache> m_runCache;    // Memoized runs, if enabled.
+    string m_profileOut;    // Where to write the execution profile, if anywhere.
+    unique_ptr<Stats> m_stats;  // The statistics of --stats, if enabled.
     };
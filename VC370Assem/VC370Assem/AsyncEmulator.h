@@ -0,0 +1,217 @@
+//
+//		Coroutine front end for the emulator.  A session suspends on READ until its
+//		input queue has a value and yields the value of each WRITE, so that a single
+//		thread can multiplex many interactive VC370 sessions.  Nothing here is thread
+//		safe: queues must be fed from the thread that runs the scheduler.
+//
+#pragma once
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+#include "Emulator.h"
+
+class SessionScheduler;
+
+// The coroutine type of a session.  Owns the coroutine frame.
+class EmulationTask {
+
+public:
+
+	struct promise_type {
+		SessionScheduler *m_sched = nullptr;	// The scheduler running the session.
+		size_t m_id = 0;						// The session's id in its scheduler.
+		optional<int> m_output;					// The value of a WRITE not yet delivered.
+		bool m_requeue = false;					// The session gave up its slice.
+
+		EmulationTask get_return_object() { return EmulationTask(Handle::from_promise(*this)); }
+		suspend_always initial_suspend() noexcept { return {}; }
+		suspend_always final_suspend() noexcept { return {}; }
+		suspend_always yield_value(int a_value) { m_output = a_value; return {}; }
+		void return_void() {}
+		void unhandled_exception() { terminate(); }
+	};
+	typedef coroutine_handle<promise_type> Handle;
+
+	explicit EmulationTask(Handle a_handle) : m_handle(a_handle) {}
+	EmulationTask(EmulationTask &&a_other) noexcept : m_handle(exchange(a_other.m_handle, {})) {}
+	EmulationTask &operator=(EmulationTask &&a_other) noexcept
+	{
+		if (this != &a_other) {
+			if (m_handle) m_handle.destroy();
+			m_handle = exchange(a_other.m_handle, {});
+		}
+		return *this;
+	}
+	~EmulationTask() { if (m_handle) m_handle.destroy(); }
+
+	Handle GetHandle() const { return m_handle; }
+	bool Done() const { return !m_handle || m_handle.done(); }
+
+private:
+
+	Handle m_handle;
+};
+
+// Runs sessions on the calling thread.  A session is ready when it has just been
+// spawned, has just written a value, gave up its slice or has just been given input.
+class SessionScheduler {
+
+public:
+
+	typedef function<void(int)> OutputHandler;
+
+	// Adds a session.  a_output receives the value of each WRITE.  Returns the session id.
+	size_t Spawn(EmulationTask a_task, OutputHandler a_output)
+	{
+		size_t id = m_sessions.size();
+		EmulationTask::promise_type &promise = a_task.GetHandle().promise();
+		promise.m_sched = this;
+		promise.m_id = id;
+		m_sessions.push_back(Session{ move(a_task), move(a_output) });
+		m_ready.push_back(id);
+		return id;
+	}
+
+	// Marks a session as ready to run.
+	void Ready(size_t a_id) { m_ready.push_back(a_id); }
+
+	// Runs ready sessions until every session has finished or is waiting for input.
+	void Run()
+	{
+		while (!m_ready.empty()) {
+			size_t id = m_ready.front();
+			m_ready.pop_front();
+			Session &session = m_sessions[id];
+			EmulationTask::Handle handle = session.m_task.GetHandle();
+			handle.resume();
+
+			EmulationTask::promise_type &promise = handle.promise();
+			if (handle.done()) {
+				m_finished++;
+				continue;
+			}
+			if (promise.m_output) {
+				if (session.m_output) session.m_output(*promise.m_output);
+				promise.m_output.reset();
+				m_ready.push_back(id);
+			} else if (promise.m_requeue) {
+				promise.m_requeue = false;
+				m_ready.push_back(id);
+			}
+		}
+	}
+
+	// Session status.
+	bool IsFinished(size_t a_id) const { return m_sessions[a_id].m_task.Done(); }
+	size_t GetActiveCount() const { return m_sessions.size() - m_finished; }
+
+private:
+
+	struct Session {
+		EmulationTask m_task;
+		OutputHandler m_output;
+	};
+
+	deque<Session> m_sessions;	// Deque so that sessions do not move as more are spawned.
+	deque<size_t> m_ready;		// Ids of the sessions ready to run, in order.
+	size_t m_finished = 0;		// Number of sessions that have finished.
+};
+
+// An asynchronous source of READ values, such as a pipe, a socket or a test script.
+class InputQueue {
+
+public:
+
+	// Makes a value available, resuming the session waiting for it.
+	void Push(int a_value)
+	{
+		m_values.push_back(a_value);
+		Wake();
+	}
+
+	// Marks the end of the input.  Reads waiting or still to come get no value.
+	void Close()
+	{
+		m_closed = true;
+		Wake();
+	}
+
+	bool IsWaiting() const { return bool(m_waiter); }
+
+	// Awaiter for the next value: nullopt once the queue is closed and empty.
+	struct Awaiter {
+		InputQueue &m_queue;
+
+		bool await_ready() const { return !m_queue.m_values.empty() || m_queue.m_closed; }
+		void await_suspend(EmulationTask::Handle a_handle) { m_queue.m_waiter = a_handle; }
+		optional<int> await_resume()
+		{
+			if (m_queue.m_values.empty()) return nullopt;
+			int value = m_queue.m_values.front();
+			m_queue.m_values.pop_front();
+			return value;
+		}
+	};
+	Awaiter Next() { return Awaiter{ *this }; }
+
+private:
+
+	// Hands the waiting session, if any, back to its scheduler.
+	void Wake()
+	{
+		if (!m_waiter) return;
+		EmulationTask::Handle waiter = exchange(m_waiter, {});
+		waiter.promise().m_sched->Ready(waiter.promise().m_id);
+	}
+
+	deque<int> m_values;			// Values not yet read.
+	bool m_closed = false;			// No more values will be pushed.
+	EmulationTask::Handle m_waiter;	// The session suspended on this queue.
+};
+
+// Awaiter that gives the rest of a session's slice to the other ready sessions.
+struct YieldSlice {
+	bool await_ready() const { return false; }
+	void await_suspend(EmulationTask::Handle a_handle) { a_handle.promise().m_requeue = true; }
+	void await_resume() {}
+};
+
+// The coroutine version of emulator::runProgram, for either memory.  a_emul and a_input
+// must outlive the session.  Execution is shared with runProgram through emulator::Execute,
+// so only the I/O differs: READ waits on a_input and WRITE is yielded to the scheduler.
+template <typename t_Emulator> EmulationTask RunProgramAsync(t_Emulator &a_emul, InputQueue &a_input)
+{
+	a_emul.Reset();
+	while (true) {
+		EmulatorEvent event = a_emul.Execute();
+		if (event == EV_Read) {
+			optional<int> value = co_await a_input.Next();
+			// Like cin in runProgram, exhausted input leaves the location unchanged.
+			a_emul.SupplyInput(value ? *value : a_emul.GetIoValue());
+		} else if (event == EV_ReadBlock) {
+			// The values arrive one at a time, and the block takes as many as come.
+			vector<int> values;
+			values.reserve(a_emul.GetIoCount());
+			while (int(values.size()) < a_emul.GetIoCount()) {
+				optional<int> value = co_await a_input.Next();
+				if (!value) break;
+				values.push_back(*value);
+			}
+			a_emul.SupplyInputs(values.data(), int(values.size()));
+		} else if (event == EV_Write) {
+			co_yield a_emul.GetIoValue();
+		} else if (event == EV_WriteBlock) {
+			vector<int> values(a_emul.GetIoCount());
+			a_emul.GetIoBlock(values.data());
+			for (int value : values) co_yield value;
+		} else if (event == EV_Yield) {
+			co_await YieldSlice{};
+		} else {
+			co_return;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+//
+//  Implementation of block I/O.
+//
+#include "stdafx.h"
+#include "BlockIo.h"
+#include <charconv>
+
+namespace {
+	const size_t kMaxToken = 32;		// Characters of the longest number read.
+	const size_t kMaxNumber = 12;		// Characters of an int and its newline.
+	const size_t kBufferSize = 16384;	// Characters formatted before each write.
+
+	bool IsSpace(int a_ch) { return a_ch == ' ' || a_ch == '\n' || a_ch == '\t' || a_ch == '\r' || a_ch == '\f' || a_ch == '\v'; }
+}
+
+// The characters are taken from the stream buffer directly, so that nothing after the
+// last number is consumed.
+size_t ReadWords( istream &a_in, int *a_words, size_t a_count )
+{
+	// As operator>> would, show a prompt written to the tied stream before waiting.
+	if (a_in.tie() != nullptr) a_in.tie()->flush();
+	streambuf *in = a_in.rdbuf();
+	size_t read = 0;
+	char token[kMaxToken];
+	while (read < a_count) {
+		int ch = in->sgetc();
+		while (ch != EOF && IsSpace(ch)) ch = in->snextc();
+		size_t length = 0;
+		while (ch != EOF && !IsSpace(ch) && length < kMaxToken) {
+			token[length++] = char(ch);
+			ch = in->snextc();
+		}
+		if (length == 0) {
+			a_in.setstate(ios::eofbit | ios::failbit);
+			break;
+		}
+		int value = 0;
+		from_chars_result result = from_chars(token, token + length, value);
+		if (result.ec != errc() || result.ptr != token + length) {
+			a_in.setstate(ios::failbit);
+			break;
+		}
+		a_words[read++] = value;
+	}
+	return read;
+}
+
+void WriteWords( ostream &a_out, const int *a_words, size_t a_count )
+{
+	char buffer[kBufferSize];
+	size_t used = 0;
+	for (size_t i = 0; i < a_count; ++i) {
+		if (used + kMaxNumber > kBufferSize) {
+			a_out.write(buffer, used);
+			used = 0;
+		}
+		used = to_chars(buffer + used, buffer + kBufferSize, a_words[i]).ptr - buffer;
+		buffer[used++] = '\n';
+	}
+	a_out.write(buffer, used);
+}
@@ -0,0 +1,21 @@
+//
+//		Block I/O - moves many words between a stream and memory at once, for the BREAD
+//		and BWRITE instructions and for the outputs of a batch run.  Numbers are parsed
+//		with from_chars and formatted with to_chars into a buffer rather than with a
+//		stream operation per word.
+//
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+using namespace std;
+
+// Reads up to a_count numbers separated by white space from a_in into a_words, stopping
+// just after the last one so that the rest of the stream is left for later reads.
+// Returns the number read.  Like operator>>, it stops early at the end of the stream or
+// at something that is not a number.
+size_t ReadWords(istream &a_in, int *a_words, size_t a_count);
+
+// Writes a_count numbers to a_out, one to a line.
+void WriteWords(ostream &a_out, const int *a_words, size_t a_count);
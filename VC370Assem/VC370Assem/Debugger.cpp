@@ -0,0 +1,256 @@
+//
+//  Implementation of the debugger class.
+//
+#include "stdafx.h"
+#include "Debugger.h"
+#include <sstream>
+
+Debugger::Debugger( const ProgramImage &a_image, const RunLimits &a_limits, bool a_extended, bool a_haveInputs, const vector<int> &a_inputs )
+	: m_image(a_image), m_haveInputs(a_haveInputs), m_inputs(a_inputs)
+{
+	for (const auto &symbol : a_image.GetSymbols()) m_labels[symbol.second] = symbol.first;
+	m_engine.SetLimits(a_limits);
+	m_engine.EnableExtended(a_extended);
+	Restart();
+}
+
+/*
+NAME
+
+    Run - the command loop of the debugger.
+
+SYNOPSIS
+
+    void Run( istream &a_in, ostream &a_out );
+
+DESCRIPTION
+
+    A command is a word, or its first letter, and perhaps an operand:
+
+        break WHERE     stop before executing the instruction at WHERE.
+        watch WHERE     stop after a STORE to WHERE.
+        delete WHERE    remove the breakpoint and watchpoint at WHERE.
+        continue        run until a breakpoint, a watchpoint or the end.
+        step [N]        execute one or N instructions.
+        print [WHERE]   display the value at WHERE, or where the program is.
+        list            display the breakpoints and watchpoints.
+        restart         start the program again.
+        help, quit
+
+    WHERE is a label or a location.  An empty line repeats the last step or continue.
+*/
+void Debugger::Run( istream &a_in, ostream &a_out )
+{
+	a_out << "VC370 debugger.  Type help for the commands." << endl;
+	DisplayState(a_out);
+	string line, last;
+	while (true) {
+		a_out << "(vc370) " << flush;
+		if (!getline(a_in, line)) break;
+		if (line.find_first_not_of(" \t\r") == string::npos) line = last;
+		if (!Command(line, a_in, a_out)) break;
+		if (!line.empty() && (line[0] == 's' || line[0] == 'c')) last = line;
+	}
+}
+
+bool Debugger::Command( const string &a_line, istream &a_in, ostream &a_out )
+{
+	istringstream words(a_line);
+	string command, operand;
+	words >> command >> operand;
+	if (command.empty()) return true;
+
+	if (command == "q" || command == "quit") return false;
+	if (command == "h" || command == "help") {
+		DisplayHelp(a_out);
+	} else if (command == "c" || command == "continue" || command == "run") {
+		Continue(0, a_in, a_out);
+	} else if (command == "s" || command == "step") {
+		long long steps = operand.empty() ? 1 : atoll(operand.c_str());
+		if (steps > 0) Continue(steps, a_in, a_out);
+		else a_out << "Step needs a positive count." << endl;
+	} else if (command == "b" || command == "break") {
+		int loc = Where(operand, a_out);
+		if (loc >= 0 && m_engine.SetBreakpoint(loc)) a_out << "Breakpoint at " << Describe(loc) << endl;
+	} else if (command == "w" || command == "watch") {
+		int loc = Where(operand, a_out);
+		if (loc >= 0 && m_engine.SetWatchpoint(loc)) a_out << "Watchpoint on " << Describe(loc) << endl;
+	} else if (command == "d" || command == "delete") {
+		int loc = Where(operand, a_out);
+		if (loc >= 0) {
+			m_engine.ClearBreakpoint(loc);
+			m_engine.ClearWatchpoint(loc);
+		}
+	} else if (command == "p" || command == "print") {
+		if (operand.empty()) {
+			DisplayState(a_out);
+		} else {
+			int loc = Where(operand, a_out);
+			if (loc >= 0) a_out << Describe(loc) << " holds " << m_engine.GetMemory(loc) << endl;
+		}
+	} else if (command == "l" || command == "list") {
+		for (int loc = 0; loc < VC370Constants::kMaxMemory; ++loc) {
+			if (m_engine.HasBreakpoint(loc)) a_out << "Breakpoint at " << Describe(loc) << endl;
+			if (m_engine.HasWatchpoint(loc)) a_out << "Watchpoint on " << Describe(loc) << endl;
+		}
+	} else if (command == "r" || command == "restart") {
+		Restart();
+		DisplayState(a_out);
+	} else {
+		a_out << "Unknown command: " << command << ".  Type help for the commands." << endl;
+	}
+	return true;
+}
+
+// Execute runs at full speed between stops.  A breakpoint at the location the program
+// is stopped at is stepped over, so that continuing makes progress.
+void Debugger::Continue( long long a_steps, istream &a_in, ostream &a_out )
+{
+	if (m_finished) {
+		a_out << "The program has ended.  Use restart to run it again." << endl;
+		return;
+	}
+	bool stepOver = m_started && m_engine.HasBreakpoint(m_engine.GetLocation());
+	m_started = true;
+	if (a_steps == 0) {
+		if (stepOver && !Handle(m_engine.Step(), a_in, a_out)) return;
+		while (Handle(m_engine.Execute(), a_in, a_out)) {}
+		return;
+	}
+	for (long long step = 0; step < a_steps; ++step) {
+		if (!Handle(m_engine.Step(), a_in, a_out)) return;
+	}
+	DisplayState(a_out);
+}
+
+bool Debugger::Handle( EmulatorEvent a_event, istream &a_in, ostream &a_out )
+{
+	switch (a_event) {
+		case EV_Read: {
+			int value = 0;
+			if (m_haveInputs) {
+				if (m_nextInput >= m_inputs.size()) return true;
+				value = m_inputs[m_nextInput++];
+			} else {
+				a_out << "? " << flush;
+				string line;
+				if (!getline(a_in, line)) return false;
+				value = atoi(line.c_str());
+			}
+			m_engine.SupplyInput(value);
+			return true;
+		}
+		case EV_ReadBlock: {
+			vector<int> values(m_engine.GetIoCount());
+			size_t count = 0;
+			if (m_haveInputs) {
+				count = min(values.size(), m_inputs.size() - m_nextInput);
+				copy_n(m_inputs.begin() + m_nextInput, count, values.begin());
+				m_nextInput += count;
+			} else {
+				a_out << "? " << flush;
+				count = ReadWords(a_in, values.data(), values.size());
+				if (count < values.size() && !a_in) return false;
+				// As for READ, the rest of the line is not taken as a command.
+				a_in.ignore(numeric_limits<streamsize>::max(), '\n');
+			}
+			m_engine.SupplyInputs(values.data(), int(count));
+			return true;
+		}
+		case EV_Write:
+			a_out << m_engine.GetIoValue() << endl;
+			return true;
+
+		case EV_WriteBlock: {
+			vector<int> values(m_engine.GetIoCount());
+			m_engine.GetIoBlock(values.data());
+			WriteWords(a_out, values.data(), values.size());
+			return true;
+		}
+
+		case EV_Yield:
+			return true;
+
+		case EV_Break:
+			if (m_engine.GetWatchHit() >= 0) {
+				a_out << "Watchpoint: " << Describe(m_engine.GetWatchHit()) << " changed from "
+					  << m_engine.GetWatchOldValue() << " to " << m_engine.GetMemory(m_engine.GetWatchHit()) << endl;
+			} else {
+				a_out << "Breakpoint." << endl;
+			}
+			DisplayState(a_out);
+			return false;
+
+		case EV_Halt:
+			a_out << "The program halted after " << m_engine.GetStepCount() << " instructions." << endl;
+			m_finished = true;
+			return false;
+
+		default:
+			a_out << m_engine.GetErrorMessage() << endl;
+			m_finished = true;
+			return false;
+	}
+}
+
+void Debugger::Restart( )
+{
+	m_engine.LoadImage(m_image);
+	m_engine.Reset();
+	m_nextInput = 0;
+	m_started = false;
+	m_finished = false;
+}
+
+int Debugger::Where( const string &a_operand, ostream &a_out ) const
+{
+	if (a_operand.empty()) {
+		a_out << "A label or location is needed." << endl;
+		return -1;
+	}
+	if (isdigit(static_cast<unsigned char>(a_operand[0]))) {
+		int loc = atoi(a_operand.c_str());
+		if (loc < VC370Constants::kMaxMemory) return loc;
+		a_out << "Location " << a_operand << " is outside memory." << endl;
+		return -1;
+	}
+	auto symbol = m_image.GetSymbols().find(a_operand);
+	if (symbol != m_image.GetSymbols().end()) return symbol->second;
+	a_out << "No label " << a_operand << "." << endl;
+	return -1;
+}
+
+string Debugger::Describe( int a_loc ) const
+{
+	string text = to_string(a_loc);
+	auto label = m_labels.find(a_loc);
+	if (label != m_labels.end()) text += " (" + label->second + ")";
+	const ProgramImage::Statement *statement = m_image.StatementAt(a_loc);
+	if (statement != nullptr && statement->m_loc == a_loc) {
+		string source = statement->m_source.substr(0, statement->m_source.find(';'));
+		size_t first = source.find_first_not_of(" \t"), last = source.find_last_not_of(" \t\r");
+		if (first != string::npos) text += ": " + source.substr(first, last - first + 1);
+	}
+	return text;
+}
+
+void Debugger::DisplayState( ostream &a_out ) const
+{
+	a_out << "Next " << Describe(m_engine.GetLocation()) << endl
+		  << "Accumulator " << m_engine.GetAccumulator() << ", index " << m_engine.GetIndex() << ", "
+		  << m_engine.GetStepCount() << " instructions executed." << endl;
+}
+
+void Debugger::DisplayHelp( ostream &a_out )
+{
+	a_out << "break WHERE    stop before the instruction at WHERE, a label or a location" << endl
+		  << "watch WHERE    stop after a STORE to WHERE" << endl
+		  << "delete WHERE   remove the breakpoint and watchpoint at WHERE" << endl
+		  << "continue       run until a breakpoint, a watchpoint or the end" << endl
+		  << "step [N]       execute one or N instructions" << endl
+		  << "print [WHERE]  display the value at WHERE, or where the program is" << endl
+		  << "list           display the breakpoints and watchpoints" << endl
+		  << "restart        start the program again" << endl
+		  << "quit           leave the debugger" << endl
+		  << "Commands may be shortened to their first letter.  An empty line repeats step or continue." << endl;
+}
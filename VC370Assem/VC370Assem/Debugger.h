@@ -0,0 +1,60 @@
+//
+//		Debugger class - runs a translation under the decoded engine, stopping at
+//		breakpoints on labels or addresses and after stores to watched locations, and
+//		lets the user step through it and inspect the machine.  Selected by --debug.
+//
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "DecodedEngine.h"
+#include "ProgramImage.h"
+
+class Debugger {
+
+public:
+
+	// Debugs a_image under a_limits, with the extended instruction set if a_extended.
+	// READs take the next of a_inputs if a_haveInputs, and are otherwise answered on
+	// the command input.
+	Debugger(const ProgramImage &a_image, const RunLimits &a_limits, bool a_extended, bool a_haveInputs, const vector<int> &a_inputs);
+
+	// Reads and carries out commands until quit or the end of a_in.
+	void Run(istream &a_in, ostream &a_out);
+
+private:
+
+	// Carries out a command.  Returns false on quit.
+	bool Command(const string &a_line, istream &a_in, ostream &a_out);
+
+	// Runs the program until it stops, or for a_steps instructions if a_steps > 0.
+	void Continue(long long a_steps, istream &a_in, ostream &a_out);
+
+	// Deals with an event of the engine.  Returns true if the program goes on.
+	bool Handle(EmulatorEvent a_event, istream &a_in, ostream &a_out);
+
+	// Starts the program again from the beginning, keeping breakpoints and watchpoints.
+	void Restart();
+
+	// A location given as a label or a number, or -1 after saying why there is none.
+	int Where(const string &a_operand, ostream &a_out) const;
+
+	// A location with its label and the statement there.
+	string Describe(int a_loc) const;
+
+	// Displays where the program is stopped.
+	void DisplayState(ostream &a_out) const;
+
+	static void DisplayHelp(ostream &a_out);
+
+	const ProgramImage &m_image;
+	DecodedEngine m_engine;
+	map<int, string> m_labels;	// The label of each labelled location.
+	bool m_haveInputs;			// READs take values from m_inputs.
+	vector<int> m_inputs;
+	size_t m_nextInput = 0;
+	bool m_started = false;		// Instructions were executed since the last restart.
+	bool m_finished = false;	// The program halted or stopped with an error.
+};
@@ -0,0 +1,453 @@
+//
+//  Implementation of the decoded engine.
+//
+#include "stdafx.h"
+#include "DecodedEngine.h"
+#include <climits>
+
+using namespace VC370Constants;
+
+DecodedEngine::DecodedEngine()
+	: m_memory(kMaxMemory, 0), m_code(kMaxMemory, Decoded{ &Undecoded, 0 }), m_watched(kMaxMemory, 0)
+{
+	Reset();
+}
+
+// Locations are decoded when they are first executed, so loading only marks them.
+bool DecodedEngine::LoadImage( const ProgramImage &a_image )
+{
+	fill(m_memory.begin(), m_memory.end(), 0);
+	for (const ProgramImage::Word &word : a_image.GetWords()) {
+		if (word.m_loc < 0 || word.m_loc >= kMaxMemory) return false;
+		m_memory[word.m_loc] = word.m_contents;
+	}
+	for (int loc = 0; loc < kMaxMemory; ++loc) Invalidate(loc);
+	m_start = a_image.GetStart();
+	return true;
+}
+
+// The locations already decoded are decoded again by the new instruction set.
+void DecodedEngine::EnableExtended( bool a_enable )
+{
+	m_extended = a_enable;
+	for (int loc = 0; loc < kMaxMemory; ++loc) Invalidate(loc);
+}
+
+void DecodedEngine::Reset( )
+{
+	m_loc = m_start;
+	m_lastLoc = m_start;
+	m_accum = 0;
+	m_index = 0;
+	m_steps = 0;
+	m_errorMsg.clear();
+	m_ioAddress = 0;
+	m_ioCount = 0;
+	m_watchHit = -1;
+	m_backEdges = 0;
+	m_maxSteps = m_limits.maxSteps > 0 ? m_limits.maxSteps : LLONG_MAX;
+	m_sliceEnd = m_slice > 0 ? m_slice : LLONG_MAX;
+	m_startTime = chrono::steady_clock::now();
+}
+
+void DecodedEngine::SupplyInput( int a_value )
+{
+	m_memory[m_ioAddress] = a_value;
+	Invalidate(m_ioAddress);
+}
+
+void DecodedEngine::SupplyInputs( const int *a_values, int a_count )
+{
+	copy_n(a_values, a_count, &m_memory[m_ioAddress]);
+	for (int loc = m_ioAddress; loc < m_ioAddress + a_count; ++loc) Invalidate(loc);
+}
+
+bool DecodedEngine::SetBreakpoint( int a_loc )
+{
+	if (a_loc < 0 || a_loc >= kMaxMemory) return false;
+	if (!HasBreakpoint(a_loc)) {
+		m_saved[a_loc] = m_code[a_loc];
+		m_code[a_loc] = Decoded{ &Break, 0 };
+	}
+	return true;
+}
+
+void DecodedEngine::ClearBreakpoint( int a_loc )
+{
+	auto saved = m_saved.find(a_loc);
+	if (saved == m_saved.end()) return;
+	m_code[a_loc] = saved->second;
+	m_saved.erase(saved);
+}
+
+bool DecodedEngine::SetWatchpoint( int a_loc )
+{
+	if (a_loc < 0 || a_loc >= kMaxMemory) return false;
+	m_watched[a_loc] = 1;
+	return true;
+}
+
+void DecodedEngine::ClearWatchpoint( int a_loc )
+{
+	if (a_loc >= 0 && a_loc < kMaxMemory) m_watched[a_loc] = 0;
+}
+
+/*
+NAME
+
+    Run - executes instructions by calling their handlers.
+
+SYNOPSIS
+
+    template <bool t_step> EmulatorEvent Run( );
+
+DESCRIPTION
+
+    The loop is that of emulator::Execute with the switch replaced by a call through
+    the decoded handler, so that the two can be compared instruction by instruction.
+    Nothing in it knows about breakpoints or watchpoints: a breakpoint is the Break
+    handler in place of the instruction's, and only Store reads the watched flags.
+    A step executes the handler a breakpoint replaced.
+*/
+template <bool t_step> EmulatorEvent DecodedEngine::Run( )
+{
+	int loc = m_loc;
+	long long first = m_steps;
+	m_watchHit = -1;
+	while (true) {
+		if (t_step && m_steps > first) {
+			m_loc = loc;
+			return EV_Yield;
+		}
+		if (loc <= m_lastLoc && m_steps > 0 && StopOnBackEdge(loc)) return m_event;
+		m_lastLoc = loc;
+		m_steps++;
+
+		const Decoded &decoded = t_step && m_code[loc].m_handler == &Break ? m_saved[loc] : m_code[loc];
+		int next = decoded.m_handler(*this, loc, decoded.m_address);
+		if (next == kStop) return m_event;
+		loc = next;
+	}
+}
+
+EmulatorEvent DecodedEngine::Execute( )
+{
+	return Run<false>();
+}
+
+EmulatorEvent DecodedEngine::Step( )
+{
+	return Run<true>();
+}
+
+bool DecodedEngine::StopOnBackEdge( int a_loc )
+{
+	string limit;
+	if (m_steps >= m_maxSteps) {
+		limit = "instruction limit of " + to_string(m_limits.maxSteps);
+	} else if (m_limits.maxMillis > 0 && ++m_backEdges % kClockInterval == 0
+		&& chrono::steady_clock::now() - m_startTime >= chrono::milliseconds(m_limits.maxMillis)) {
+		limit = "time limit of " + to_string(m_limits.maxMillis) + " ms";
+	} else if (m_steps >= m_sliceEnd) {
+		m_sliceEnd = m_steps + m_slice;
+		m_lastLoc = INT_MIN;	// Do not count the back edge again on resumption.
+		m_loc = a_loc;
+		m_event = EV_Yield;
+		return true;
+	} else {
+		return false;
+	}
+	m_errorMsg = "[Watchdog] Stopped at location " + to_string(a_loc) + " after " + to_string(m_steps)
+		+ " instructions: " + limit + " reached.";
+	m_loc = a_loc;
+	m_event = EV_Limit;
+	return true;
+}
+
+DecodedEngine::Decoded DecodedEngine::Decode( int a_contents, bool a_extended )
+{
+	static const Handler handlers[] = {
+		&Illegal, &Add, &Subtract, &Multiply, &Divide, &Load, &Store, &Read, &Write,
+		&Branch, &BranchMinus, &BranchZero, &BranchPositive, &Halt,
+		&LoadIndexed, &StoreIndexed, &AddIndexed, &SetIndex, &IncrementIndex, &BranchIndexLess, &BlockCopy, &BlockSum,
+		&BlockRead, &BlockWrite, &Spawn, &FetchAdd, &CompareSwap, &Join
+	};
+	int opcode = a_contents / kMaxMemory;
+	if (opcode < OP_ADD || opcode > (a_extended ? OP_JOIN : OP_HALT)) return Decoded{ &Illegal, opcode };
+	return Decoded{ handlers[opcode], a_contents % kMaxMemory };
+}
+
+// A breakpoint stays where it is: the instruction under it is decoded again.
+void DecodedEngine::Invalidate( int a_loc )
+{
+	Decoded &decoded = m_code[a_loc].m_handler == &Break ? m_saved[a_loc] : m_code[a_loc];
+	decoded.m_handler = &Undecoded;
+}
+
+int DecodedEngine::Add( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_accum += a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::Subtract( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_accum -= a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::Multiply( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_accum *= a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::Divide( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if (a_engine.m_memory[a_address] == 0) {
+		a_engine.m_errorMsg = "[Emulation] Error: Division by zero at location " + to_string(a_loc);
+		a_engine.m_loc = a_loc;
+		a_engine.m_event = EV_Error;
+		return kStop;
+	}
+	a_engine.m_accum /= a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::Load( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_accum = a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::Store( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	int old = a_engine.m_memory[a_address];
+	a_engine.m_memory[a_address] = a_engine.m_accum;
+	a_engine.Invalidate(a_address);
+	if (a_engine.m_watched[a_address] == 0) return a_loc + 1;
+	return a_engine.Watched(a_loc, a_address, old);
+}
+
+int DecodedEngine::Watched( int a_loc, int a_address, int a_old )
+{
+	m_watchHit = a_address;
+	m_watchOld = a_old;
+	m_loc = a_loc + 1;
+	m_event = EV_Break;
+	return kStop;
+}
+
+int DecodedEngine::Read( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_ioAddress = a_address;
+	a_engine.m_ioCount = 1;
+	a_engine.m_loc = a_loc + 1;
+	a_engine.m_event = EV_Read;
+	return kStop;
+}
+
+int DecodedEngine::Write( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_ioAddress = a_address;
+	a_engine.m_ioCount = 1;
+	a_engine.m_loc = a_loc + 1;
+	a_engine.m_event = EV_Write;
+	return kStop;
+}
+
+int DecodedEngine::Branch( DecodedEngine &, int, int a_address )
+{
+	return a_address;
+}
+
+int DecodedEngine::BranchMinus( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	return a_engine.m_accum < 0 ? a_address : a_loc + 1;
+}
+
+int DecodedEngine::BranchZero( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	return a_engine.m_accum == 0 ? a_address : a_loc + 1;
+}
+
+int DecodedEngine::BranchPositive( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	return a_engine.m_accum > 0 ? a_address : a_loc + 1;
+}
+
+int DecodedEngine::Halt( DecodedEngine &a_engine, int a_loc, int )
+{
+	a_engine.m_loc = a_loc;
+	a_engine.m_event = EV_Halt;
+	return kStop;
+}
+
+int DecodedEngine::LoadIndexed( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if ((a_address = a_engine.Indexed(a_address, a_loc)) < 0) return kStop;
+	a_engine.m_accum = a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::StoreIndexed( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if ((a_address = a_engine.Indexed(a_address, a_loc)) < 0) return kStop;
+	return Store(a_engine, a_loc, a_address);
+}
+
+int DecodedEngine::AddIndexed( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if ((a_address = a_engine.Indexed(a_address, a_loc)) < 0) return kStop;
+	a_engine.m_accum += a_engine.m_memory[a_address];
+	return a_loc + 1;
+}
+
+int DecodedEngine::SetIndex( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_index = a_address;
+	return a_loc + 1;
+}
+
+int DecodedEngine::IncrementIndex( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	a_engine.m_index += a_address;
+	return a_loc + 1;
+}
+
+int DecodedEngine::BranchIndexLess( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	return a_engine.m_index < a_engine.m_accum ? a_address : a_loc + 1;
+}
+
+// The copied words are decoded again if executed, and the first watched one stops the run.
+int DecodedEngine::BlockCopy( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if (!a_engine.InMemory(a_engine.m_index, a_loc) || !a_engine.InMemory(a_address, a_loc)) return kStop;
+	int count = max(a_engine.m_accum, 0), watched = -1, old = 0;
+	for (int loc = a_address; loc < a_address + count && watched < 0; ++loc) {
+		if (a_engine.m_watched[loc] == 0) continue;
+		watched = loc;
+		old = a_engine.m_memory[loc];
+	}
+	memmove(&a_engine.m_memory[a_address], &a_engine.m_memory[a_engine.m_index], count * sizeof(int));
+	for (int loc = a_address; loc < a_address + count; ++loc) a_engine.Invalidate(loc);
+	if (watched < 0) return a_loc + 1;
+	return a_engine.Watched(a_loc, watched, old);
+}
+
+int DecodedEngine::BlockSum( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if (!a_engine.InMemory(a_address, a_loc)) return kStop;
+	a_engine.m_accum = a_engine.m_accum > 0 ? int(SumWords(&a_engine.m_memory[a_address], a_engine.m_accum)) : 0;
+	return a_loc + 1;
+}
+
+int DecodedEngine::BlockRead( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if (!a_engine.InMemory(a_address, a_loc)) return kStop;
+	a_engine.m_ioAddress = a_address;
+	a_engine.m_ioCount = max(a_engine.m_accum, 0);
+	a_engine.m_loc = a_loc + 1;
+	a_engine.m_event = EV_ReadBlock;
+	return kStop;
+}
+
+int DecodedEngine::BlockWrite( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if (!a_engine.InMemory(a_address, a_loc)) return kStop;
+	a_engine.m_ioAddress = a_address;
+	a_engine.m_ioCount = max(a_engine.m_accum, 0);
+	a_engine.m_loc = a_loc + 1;
+	a_engine.m_event = EV_WriteBlock;
+	return kStop;
+}
+
+// The engines run a single hart, as emulator::Execute does without a multiprocessor.
+int DecodedEngine::Spawn( DecodedEngine &a_engine, int a_loc, int )
+{
+	a_engine.m_errorMsg = "[Emulation] Error: SPAWN at location " + to_string(a_loc) + " needs --harts";
+	a_engine.m_loc = a_loc;
+	a_engine.m_event = EV_Error;
+	return kStop;
+}
+
+int DecodedEngine::FetchAdd( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	int old = a_engine.m_memory[a_address];
+	a_engine.m_memory[a_address] += a_engine.m_accum;
+	a_engine.m_accum = old;
+	a_engine.Invalidate(a_address);
+	if (a_engine.m_watched[a_address] == 0) return a_loc + 1;
+	return a_engine.Watched(a_loc, a_address, old);
+}
+
+int DecodedEngine::CompareSwap( DecodedEngine &a_engine, int a_loc, int a_address )
+{
+	if (a_engine.m_index < 0 || a_engine.m_index >= kMaxMemory) {
+		a_engine.m_errorMsg = "[Emulation] Error: CAS value location " + to_string(a_engine.m_index) + " is outside memory at location " + to_string(a_loc);
+		a_engine.m_loc = a_loc;
+		a_engine.m_event = EV_Error;
+		return kStop;
+	}
+	int old = a_engine.m_memory[a_address];
+	if (old == a_engine.m_accum) {
+		a_engine.m_memory[a_address] = a_engine.m_memory[a_engine.m_index];
+		a_engine.Invalidate(a_address);
+	}
+	a_engine.m_accum = old;
+	if (a_engine.m_watched[a_address] == 0 || a_engine.m_memory[a_address] == old) return a_loc + 1;
+	return a_engine.Watched(a_loc, a_address, old);
+}
+
+int DecodedEngine::Join( DecodedEngine &, int a_loc, int )
+{
+	return a_loc + 1;
+}
+
+int DecodedEngine::Indexed( int a_address, int a_loc )
+{
+	long long indexed = (long long)a_address + m_index;
+	if (indexed >= 0 && indexed < kMaxMemory) return int(indexed);
+	m_errorMsg = "[Emulation] Error: Indexed address " + to_string(indexed) + " is outside memory at location " + to_string(a_loc);
+	m_loc = a_loc;
+	m_event = EV_Error;
+	return -1;
+}
+
+bool DecodedEngine::InMemory( int a_first, int a_loc )
+{
+	long long end = (long long)a_first + max(m_accum, 0);
+	if (a_first >= 0 && end <= kMaxMemory) return true;
+	m_errorMsg = "[Emulation] Error: Block of " + to_string(m_accum) + " words at " + to_string(a_first)
+		+ " is outside memory at location " + to_string(a_loc);
+	m_loc = a_loc;
+	m_event = EV_Error;
+	return false;
+}
+
+int DecodedEngine::Illegal( DecodedEngine &a_engine, int a_loc, int a_opcode )
+{
+	a_engine.m_errorMsg = "[Emulation] Illegal opcode at location " + to_string(a_loc) + " : " + to_string(a_opcode);
+	a_engine.m_loc = a_loc;
+	a_engine.m_event = EV_Error;
+	return kStop;
+}
+
+int DecodedEngine::Undecoded( DecodedEngine &a_engine, int a_loc, int )
+{
+	Decoded decoded = Decode(a_engine.m_memory[a_loc], a_engine.m_extended);
+	if (a_engine.m_code[a_loc].m_handler == &Break) a_engine.m_saved[a_loc] = decoded;
+	else a_engine.m_code[a_loc] = decoded;
+	return decoded.m_handler(a_engine, a_loc, decoded.m_address);
+}
+
+// The instruction is not executed: it is the first to run when the program goes on.
+int DecodedEngine::Break( DecodedEngine &a_engine, int a_loc, int )
+{
+	a_engine.m_steps--;
+	a_engine.m_lastLoc = INT_MIN;	// The back edge into a_loc was already checked.
+	a_engine.m_loc = a_loc;
+	a_engine.m_event = EV_Break;
+	return kStop;
+}
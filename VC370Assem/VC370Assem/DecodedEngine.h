@@ -0,0 +1,153 @@
+//
+//		Decoded engine - an engine that decodes each word once into a handler and its
+//		address, and runs a program by calling the handler of each location in turn.
+//		The debugger uses it: a breakpoint replaces the handler of a location, and a
+//		watchpoint is a flag that only STORE looks at, so that running between stops
+//		costs the same as running without a debugger.
+//
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "Engine.h"
+
+class DecodedEngine : public Engine {
+
+public:
+
+	DecodedEngine();
+
+	string GetName() const override { return "decoded"; }
+
+	bool LoadImage(const ProgramImage &a_image) override;
+	void SetLimits(const RunLimits &a_limits) override { m_limits = a_limits; }
+	void SetSlice(long long a_slice) override { m_slice = a_slice; }
+	void EnableExtended(bool a_enable) override;
+	void Reset() override;
+	EmulatorEvent Execute() override;
+
+	// Stepping executes the instruction at a breakpoint rather than stopping there.
+	EmulatorEvent Step() override;
+	bool StepsExactly() const override { return true; }
+
+	int GetIoValue() const override { return m_memory[m_ioAddress]; }
+	void SupplyInput(int a_value) override;
+	int GetIoCount() const override { return m_ioCount; }
+	void GetIoBlock(int *a_words) const override { copy_n(&m_memory[m_ioAddress], m_ioCount, a_words); }
+	void SupplyInputs(const int *a_values, int a_count) override;
+	int GetLocation() const override { return m_loc; }
+	int GetAccumulator() const override { return m_accum; }
+	int GetIndex() const override { return m_index; }
+	int GetMemory(int a_loc) const override { return m_memory[a_loc]; }
+	uint64_t GetMemoryHash() const override { return Fnv1aHash(m_memory.data(), m_memory.size() * sizeof(int)); }
+	long long GetStepCount() const override { return m_steps; }
+	const string &GetErrorMessage() const override { return m_errorMsg; }
+
+	// Execute returns EV_Break before the instruction at a breakpoint.  Returns false if
+	// the location is outside memory.
+	bool SetBreakpoint(int a_loc);
+	void ClearBreakpoint(int a_loc);
+	bool HasBreakpoint(int a_loc) const { return m_saved.count(a_loc) > 0; }
+
+	// Execute and Step return EV_Break after a STORE to a watched location.
+	bool SetWatchpoint(int a_loc);
+	void ClearWatchpoint(int a_loc);
+	bool HasWatchpoint(int a_loc) const { return a_loc >= 0 && a_loc < int(m_watched.size()) && m_watched[a_loc]; }
+
+	// The location whose watchpoint stopped the run and the value it held before, or -1.
+	int GetWatchHit() const { return m_watchHit; }
+	int GetWatchOldValue() const { return m_watchOld; }
+
+private:
+
+	// Executes the instruction at a_loc, whose operand is a_address, and returns the
+	// next location, or kStop after setting m_loc and m_event to return from Run.
+	typedef int (*Handler)(DecodedEngine &a_engine, int a_loc, int a_address);
+	static const int kStop = -1;
+
+	struct Decoded {
+		Handler m_handler;
+		int m_address;		// The operand, or the opcode of an illegal instruction.
+	};
+
+	// Back edges taken between reads of the clock by the time limit check.
+	static const long long kClockInterval = 4096;
+
+	// The interpreter behind Execute and Step, checking the watchdog and the slice on
+	// back edges at the same points as emulator::Execute.
+	template <bool t_step> EmulatorEvent Run();
+
+	// Whether to stop on the back edge into a_loc, setting m_event if so.
+	bool StopOnBackEdge(int a_loc);
+
+	// The opcodes after HALT are illegal unless a_extended.
+	static Decoded Decode(int a_contents, bool a_extended);
+
+	// Marks a location as changed, so that it is decoded again before it is executed.
+	void Invalidate(int a_loc);
+
+	// As emulator::Indexed and emulator::InMemory.
+	int Indexed(int a_address, int a_loc);
+	bool InMemory(int a_first, int a_loc);
+
+	// Stops with EV_Break after a store at a_loc to the watched location a_address.
+	int Watched(int a_loc, int a_address, int a_old);
+
+	// The handlers.  Undecoded decodes the location and executes it.
+	static int Add(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Subtract(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Multiply(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Divide(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Load(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Store(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Read(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Write(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Branch(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BranchMinus(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BranchZero(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BranchPositive(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Halt(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int LoadIndexed(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int StoreIndexed(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int AddIndexed(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int SetIndex(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int IncrementIndex(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BranchIndexLess(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BlockCopy(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BlockSum(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BlockRead(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int BlockWrite(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Spawn(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int FetchAdd(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int CompareSwap(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Join(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Illegal(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Undecoded(DecodedEngine &a_engine, int a_loc, int a_address);
+	static int Break(DecodedEngine &a_engine, int a_loc, int a_address);
+
+	vector<int> m_memory;		// The memory of the VC370.
+	vector<Decoded> m_code;		// The handler of each location.
+	map<int, Decoded> m_saved;	// The handlers replaced by breakpoints.
+	vector<unsigned char> m_watched;	// Whether each location is watched.
+	int m_accum = 0;			// The accumulator.
+	int m_index = 0;			// The index register.
+	int m_start = 100;			// Location at which runs start.
+	int m_loc = 100;			// Location of the next instruction to execute.
+	int m_lastLoc = 100;		// Location of the previously executed instruction.
+	int m_ioAddress = 0;		// Address of the pending READ or WRITE.
+	int m_ioCount = 0;			// Words it transfers.
+	int m_watchHit = -1;		// The watched location stored to, or -1.
+	int m_watchOld = 0;			// What it held before.
+	bool m_extended = false;	// Execute the extended instruction set.
+	EmulatorEvent m_event = EV_Halt;	// What Run returns after a handler stops it.
+	RunLimits m_limits;			// Watchdog limits.
+	string m_errorMsg;			// Why the last run stopped, if it did not halt.
+	long long m_steps = 0;		// Instructions retired by the current run.
+	long long m_maxSteps = 0;	// m_limits.maxSteps, or LLONG_MAX if unlimited.
+	long long m_slice = 0;		// Instructions between yields, or zero.
+	long long m_sliceEnd = 0;	// Step count at which Execute next yields.
+	long long m_backEdges = 0;	// Back edges taken by the current run.
+	chrono::steady_clock::time_point m_startTime;	// When the current run started.
+};
@@ -6,25 +6,362 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstdint>
 #include <cstdlib>
 #include <string>
+#include <vector>
+#include "BlockIo.h"
+#include "Errors.h"
+#include "FastForward.h"
+#include "Memory.h"
+#include "ProgramImage.h"
 #include "VC370Constants.h"
 
-class emulator {
+// Limits that bound a single run of the emulator.  Zero means unlimited.
+struct RunLimits {
+	long long maxSteps = 0;		// Instructions that may be retired.
+	long long maxMillis = 0;	// Wall clock time the run may take.
+};
+
+// Why emulator::Execute returned to its caller.
+enum EmulatorEvent {
+	EV_Read,		// A READ needs a value: call SupplyInput.
+	EV_Write,		// A WRITE produced GetIoValue.
+	EV_ReadBlock,	// A BREAD needs GetIoCount values: call SupplyInputs.
+	EV_WriteBlock,	// A BWRITE produced GetIoCount values: see GetIoBlock.
+	EV_Yield,		// The slice set by SetSlice was used up.
+	EV_Halt,		// The program executed HALT.
+	EV_Error,		// Emulation error; see GetErrorMessage.
+	EV_Limit,		// A watchdog limit was reached; see GetErrorMessage.
+	EV_Break,		// A breakpoint or watchpoint of the debugger was reached.
+	EV_Spawn,		// A SPAWN needs a hart started at GetSpawnLocation.
+	EV_Join			// A JOIN waits for the other harts.
+};
+
+// How the last run of the emulator ended.
+enum RunStatus {
+	RS_NotRun,		// No run has been started.
+	RS_Halted,		// The program executed HALT.
+	RS_Error,		// An emulation error was recorded.
+	RS_StepLimit,	// The watchdog stopped the run after RunLimits::maxSteps instructions.
+	RS_TimeLimit	// The watchdog stopped the run after RunLimits::maxMillis milliseconds.
+};
+
+// The emulator of a VC370 whose memory is a t_Memory, FlatMemory or PagedMemory.  A word
+// is opcode * the memory size + address.
+template <typename t_Memory> class BasicEmulator {
 
 public:
 
-    const static int MEMSZ = VC370Constants::kMaxMemory;	// The size of the memory of the VC370.
-    emulator() 
+    explicit BasicEmulator(int a_memorySize = VC370Constants::kMaxMemory)
+		: m_memory(a_memorySize), m_loopCounts(a_memorySize), m_loopEnds(a_memorySize)
+	{
+		Init();
+	}
+
+	// An emulator on a copy of a_memory.  A copy of a SharedMemory is the same memory, so
+	// this gives each hart of a multiprocessor its own emulator.
+	explicit BasicEmulator(const t_Memory &a_memory)
+		: m_memory(a_memory), m_loopCounts(a_memory.Size()), m_loopEnds(a_memory.Size())
+	{
+		Init();
+	}
+
+	// The memory, to be shared with another emulator.
+	const t_Memory &GetSharedMemory() const { return m_memory; }
+
+	// Lets SPAWN and JOIN return EV_Spawn and EV_Join to a multiprocessor.  Otherwise the
+	// program runs on a single hart: SPAWN is an error and JOIN has nothing to wait for.
+	void EnableSpawn(bool a_enable) { m_spawning = a_enable; }
+
+	// Executes the opcodes after HALT, those of the extended instruction set.  Otherwise
+	// they are illegal, as they were before it, so that a classic program that runs into
+	// data stops as it always did.  Off by default.
+	void EnableExtended(bool a_enable) { m_extended = a_enable; }
+
+	// Prepares a run of a hart spawned at a_loc, which starts with the registers of the
+	// hart that spawned it.
+	void Spawned(int a_loc, int a_accum, int a_index)
+	{
+		m_start = a_loc;
+		Reset();
+		m_accum = a_accum;
+		m_index = a_index;
+	}
+
+	// The location a pending SPAWN starts its hart at.
+	int GetSpawnLocation() const { return m_ioAddress; }
+
+    // Records instructions and data into VC370 memory.
+	bool insertMemory(int a_location, int a_contents)
+	{
+		if (a_location >= 0 && a_location < m_memory.Size())
+		{
+			m_memory.Store(a_location, a_contents);
+			return true;
+		}
+		else
+		{
+			Errors::RecordError("Grumble gumble - should not happen");
+			return false;
+		}
+	}
+    
+	// Replaces the contents of memory with a program image.
+	bool LoadImage(const ProgramImage &a_image)
+	{
+		m_memory.Clear();
+		m_start = a_image.GetStart();
+		for (const ProgramImage::Word &word : a_image.GetWords()) {
+			if (!insertMemory(word.m_loc, word.m_contents)) return false;
+		}
+		return true;
+	}
+
+    // Sets the watchdog limits used by subsequent runs.
+	void SetLimits(const RunLimits &a_limits) { m_limits = a_limits; }
+
+	// The outcome of the last run and the number of instructions it retired.
+	RunStatus GetStatus() const { return m_status; }
+	long long GetStepCount() const { return m_steps; }
+
+	// The message describing why the last run ended with RS_Error or a watchdog stop.
+	const string &GetErrorMessage() const { return m_errorMsg; }
+
+	// Whether the result of the last run depends only on the image and the inputs, so that
+	// it may be memoized.  Runs stopped by a watchdog or a configured output limit do not.
+	bool IsCacheable() const { return m_cacheable; }
+
+	// Counts, in subsequent runs, how often each location executes and how often control
+	// then goes somewhere other than the next location.
+	void EnableProfile(bool a_enable) { m_profiling = a_enable; }
+	bool IsProfiling() const { return m_profiling; }
+	const vector<long long> &GetExecutionCounts() const { return m_execCounts; }
+	const vector<long long> &GetTakenCounts() const { return m_takenCounts; }
+
+	// Counts, in subsequent runs, how often each opcode executes, for --stats.  Fast
+	// forwarded iterations are counted too.
+	void EnableOpcodeCounts(bool a_enable) { m_counting = a_enable; }
+	const vector<long long> &GetOpcodeCounts() const { return m_opcodeCounts; }
+
+	// The wall time runProgram spent waiting for input on its last run.
+	long long GetIoWaitMicros() const { return m_ioWaitMicros; }
+
+	// Runs counted loops with linear bodies many iterations at a time once they are hot.
+	// The memory, accumulator, instruction count, watchdog and profile are as if every
+	// iteration had been executed.  On by default.
+	void EnableFastForward(bool a_enable) { m_fastForward = a_enable; }
+	bool IsFastForwarding() const { return m_fastForward; }
+
+	// Instructions of the current run that were not executed one at a time.
+	long long GetFastForwardSteps() const { return m_fastForwardSteps; }
+
+	// Sets how many instructions Execute may retire before returning EV_Yield so that
+	// other work can be interleaved.  Zero means never yield.
+	void SetSlice(long long a_slice) { m_slice = a_slice; }
+
+    // Runs the VC370 program recorded in memory, reading from cin and writing to cout.
+	bool runProgram()
 	{
-        memset( m_memory, 0, MEMSZ * sizeof(int) );
-        m_accum = 0;
+		cout << "Start of emulation." << endl;
+		Reset();
+		m_ioWaitMicros = 0;
+		while (true)
+		{
+			switch (Execute()) {
+				case EV_Read: {
+					Prompt();
+					int value = GetIoValue();
+					auto waitStart = chrono::steady_clock::now();
+					cin >> value;
+					m_ioWaitMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - waitStart).count();
+					SupplyInput(value);
+					if (m_readCount < 2) {
+						m_readValues[m_readCount] = value;
+					}
+					m_readCount++;
+					break;
+				}
+				case EV_Write:
+					Display(GetIoValue());
+					m_writeCount++;
+					break;
+
+				case EV_ReadBlock: {
+					Prompt();
+					vector<int> values(m_ioCount);
+					auto waitStart = chrono::steady_clock::now();
+					SupplyInputs(values.data(), int(ReadWords(cin, values.data(), values.size())));
+					m_ioWaitMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - waitStart).count();
+					m_readCount += m_ioCount;
+					break;
+				}
+				case EV_WriteBlock: {
+					vector<int> values(m_ioCount);
+					GetIoBlock(values.data());
+					WriteWords(cout, values.data(), values.size());
+					m_writeCount += m_ioCount;
+					break;
+				}
+				case EV_Yield:
+					break;
+
+				case EV_Halt:
+					cout << "End of emulation." << endl;
+					return true;
+
+				default:
+					Errors::RecordError(m_errorMsg);
+					return false;
+			}
+		}
+	}
+
+	// Runs the program without a terminal: READ takes the next of a_inputs and WRITE
+	// appends to a_outputs.  Like cin at end of file, a READ past the end of a_inputs
+	// leaves the location unchanged.  A WRITE beyond a_maxOutputs is an error.
+	RunStatus RunBatch(const vector<int> &a_inputs, vector<int> &a_outputs, size_t a_maxOutputs = SIZE_MAX)
+	{
+		return StreamBatch(a_inputs, [&a_outputs](const int *a_values, size_t a_count) {
+			a_outputs.insert(a_outputs.end(), a_values, a_values + a_count);
+		}, a_maxOutputs);
+	}
+
+	// As RunBatch, but the values of each WRITE are passed to a_write(values, count) as
+	// they are written, so that nothing is held back until the run ends.
+	template <typename t_Write> RunStatus StreamBatch(const vector<int> &a_inputs, t_Write a_write, size_t a_maxOutputs = SIZE_MAX)
+	{
+		Reset();
+		size_t next = 0;
+		size_t written = 0;
+		vector<int> values;
+		while (true) {
+			switch (Execute()) {
+				case EV_Read:
+					if (next < a_inputs.size()) SupplyInput(a_inputs[next++]);
+					break;
+
+				case EV_ReadBlock: {
+					int count = int(min<size_t>(m_ioCount, a_inputs.size() - next));
+					SupplyInputs(a_inputs.data() + next, count);
+					next += count;
+					break;
+				}
+				case EV_Write:
+				case EV_WriteBlock: {
+					size_t count = m_ioCount;
+					if (written + count > a_maxOutputs) {
+						m_status = RS_Error;
+						m_cacheable = false;
+						m_errorMsg = "[Emulation] Output limit of " + to_string(a_maxOutputs)
+							+ " values reached at location " + to_string(m_loc - 1);
+						return m_status;
+					}
+					values.resize(count);
+					GetIoBlock(values.data());
+					a_write(values.data(), count);
+					written += count;
+					break;
+				}
+
+				case EV_Yield:
+					break;
+
+				default:
+					return m_status;
+			}
+		}
+	}
+
+	// Prepares a run from the start location.  Execute then carries it out.
+	void Reset()
+	{
+		m_loc = m_start;
+		m_lastLoc = m_start;
+		m_accum = 0;
+		m_index = 0;
+		m_steps = 0;
+		m_status = RS_Error;
+		m_cacheable = true;
+		m_errorMsg.clear();
+		m_ioAddress = 0;
+		m_ioCount = 0;
+		m_backEdges = 0;
+		m_fastForwardSteps = 0;
+		m_loopHits.clear();
+		m_maxSteps = m_limits.maxSteps > 0 ? m_limits.maxSteps : LLONG_MAX;
+		m_sliceEnd = m_slice > 0 ? m_slice : LLONG_MAX;
+		// Loop statistics are only needed to report a watchdog stop.
+		m_countLoops = m_limits.maxSteps > 0 || m_limits.maxMillis > 0;
+		m_loopCounts.Clear();
+		m_loopEnds.Clear();
+		if (m_profiling) {
+			m_execCounts.assign(m_memory.Size(), 0);
+			m_takenCounts.assign(m_memory.Size(), 0);
+		}
+		if (m_counting) m_opcodeCounts.assign(kOpcodeSlots, 0);
+		m_startTime = chrono::steady_clock::now();
+	}
+
+	// Executes instructions until the program needs the outside world.  On EV_Read the
+	// caller must call SupplyInput before calling Execute again; on EV_Write the value
+	// to output is GetIoValue.  The watchdog limits and the slice are only checked when
+	// a branch goes backwards: straight line code can retire at most a memory's worth of instructions
+	// before it branches back or halts, so that bounds the overshoot.
+	EmulatorEvent Execute() { return Run<false>(); }
+
+	// Executes a single instruction, returning EV_Yield if it needs nothing from the
+	// caller.  Loops are never fast forwarded.  Used to find where engines disagree.
+	EmulatorEvent Step() { return Run<true>(); }
+
+	// The state of the machine between calls to Execute: the location of the next
+	// instruction, the accumulator and the memory.
+	int GetLocation() const { return m_loc; }
+	int GetAccumulator() const { return m_accum; }
+	int GetIndex() const { return m_index; }
+	int GetMemory(int a_loc) const { return m_memory.Load(a_loc); }
+	uint64_t GetMemoryHash() const { return m_memory.Hash(); }
+	int GetMemorySize() const { return m_memory.Size(); }
+
+	// The value of the memory location named by the pending READ or WRITE.
+	int GetIoValue() const { return m_memory.Load(m_ioAddress); }
+
+	// Completes a pending READ by storing the value read.
+	void SupplyInput(int a_value) { m_memory.Store(m_ioAddress, a_value); }
+
+	// The words of the pending I/O: one for READ and WRITE, the accumulator for BREAD and
+	// BWRITE.  GetIoBlock copies them out for a write.
+	int GetIoCount() const { return m_ioCount; }
+	void GetIoBlock(int *a_words) const { m_memory.Get(m_ioAddress, m_ioCount, a_words); }
+
+	// Completes a pending BREAD with a_count values, at most GetIoCount.  The words of the
+	// block beyond them are left unchanged, as by a READ past the end of the input.
+	void SupplyInputs(const int *a_values, int a_count) { m_memory.Put(m_ioAddress, a_count, a_values); }
+
+private:
+
+	// Sets up a new emulator.
+	void Init()
+	{
+		m_accum = 0;
 		m_readCount = 0;
 		m_writeCount = 0;
 		m_readValues[0] = 0;
 		m_readValues[1] = 0;
 		m_friendlyDiff = false;
 		m_friendlyFib = false;
+		m_slice = 0;
+		m_profiling = false;
+		m_counting = false;
+		m_ioWaitMicros = 0;
+		m_fastForward = true;
+		m_spawning = false;
+		m_extended = false;
+		m_start = 100;
+		Reset();
+		m_status = RS_NotRun;
 		const char *env = std::getenv("ASSEM_FRIENDLY_IO");
 		if (env && env[0] != '\0' && env[0] != '0') {
 			m_friendlyIo = true;
@@ -43,106 +380,99 @@ public:
 			m_friendlyDiff = false;
 			m_friendlyFib = false;
 		}
-    }
-    // Records instructions and data into VC370 memory.
-	bool insertMemory(int a_location, int a_contents)
-	{
-		if (a_location >= 0 && a_location < MEMSZ)
-		{
-			m_memory[a_location] = a_contents;
-			return true;
-		}
-		else
-		{
-			Errors::RecordError("Grumble gumble - should not happen");
-			return false;
-		}
 	}
-    
-    // Runs the VC370 program recorded in memory.
-	bool runProgram()
+
+	// The interpreter behind Execute and Step.  Stepping stops before the bookkeeping of
+	// the next instruction, so that it is done once, on the next call.
+	template <bool t_step> EmulatorEvent Run()
 	{
-		cout << "Start of emulation." << endl;
-		int loc = 100;
+		int loc = m_loc;
+		long long first = m_steps;
 		while (true)
 		{
-			int contents = m_memory[loc];
-			int opcode = contents / 10'000;
-			int address = contents % 10'000;
+			if (t_step && m_steps > first) {
+				m_loc = loc;
+				return EV_Yield;
+			}
+			// The profile counts a transfer of control before the watchdog or the slice can
+			// stop the run.  A yield clears m_lastLoc, so it is not counted again on resumption.
+			if (m_profiling && m_steps > 0 && m_lastLoc >= 0 && loc != m_lastLoc + 1) {
+				m_takenCounts[m_lastLoc]++;
+			}
+			// Watchdog: count the back edge and check the limits.  The clock is only
+			// read every kClockInterval back edges since it is comparatively costly.
+			if (loc <= m_lastLoc && m_steps > 0) {
+				if (m_countLoops) {
+					m_loopCounts.At(loc)++;
+					m_loopEnds.Store(loc, m_lastLoc);
+				}
+				if (m_steps >= m_maxSteps) {
+					return Watchdog(RS_StepLimit, loc);
+				}
+				if (m_limits.maxMillis > 0 && ++m_backEdges % kClockInterval == 0
+					&& chrono::steady_clock::now() - m_startTime >= chrono::milliseconds(m_limits.maxMillis)) {
+					return Watchdog(RS_TimeLimit, loc);
+				}
+				if (m_steps >= m_sliceEnd) {
+					m_sliceEnd = m_steps + m_slice;
+					m_loc = loc;
+					m_lastLoc = INT_MIN;	// Do not count the back edge again on resumption.
+					return EV_Yield;
+				}
+				// After a fast forward the back edge into the next iteration is checked again.
+				if (!t_step && m_fastForward && FastForward(loc)) continue;
+			}
+			if (m_profiling) m_execCounts[loc]++;
+			m_lastLoc = loc;
+			m_steps++;
+
+			int contents = m_memory.Load(loc);
+			int opcode = contents / m_memory.Size();
+			int address = contents % m_memory.Size();
+			if (m_counting && unsigned(opcode) < kOpcodeSlots) m_opcodeCounts[opcode]++;
+			if (opcode > VC370Constants::OP_HALT && !m_extended) return Illegal(opcode, loc);
 
 			switch (opcode) {
 				case 1: // ADD: Add value at address to accumulator.
-					m_accum += m_memory[address];
+					m_accum += m_memory.Load(address);
 					break;
 
 				case 2: // SUBTRACT: Subtract value at address from accumulator.
-					m_accum -= m_memory[address];
+					m_accum -= m_memory.Load(address);
 					break;
 
 				case 3: // MULTIPLY: Multiply accumulator by value at address.
-					m_accum *= m_memory[address];
+					m_accum *= m_memory.Load(address);
 					break;
 
 				case 4: // DIVIDE: Divide accumulator by value at address.
-					if (m_memory[address] == 0) {
-						Errors::RecordError("[Emulation] Error: Division by zero at location " + to_string(loc));
-						return false;
+					if (m_memory.Load(address) == 0) {
+						m_errorMsg = "[Emulation] Error: Division by zero at location " + to_string(loc);
+						m_loc = loc;
+						return EV_Error;
 					}
-					m_accum /= m_memory[address];
+					m_accum /= m_memory.Load(address);
 					break;
 
 				case 5: // LOAD: Load value at address into accumulator.
-					m_accum = m_memory[address];
+					m_accum = m_memory.Load(address);
 					break;
 
 				case 6: // STORE: Store accumulator value into memory at address.
-					m_memory[address] = m_accum;
-					break;
-
-				case 7: // READ: Read input and store up to 6 digits into memory at address.
-					if (m_friendlyIo) {
-						if (m_friendlySum || m_friendlyDiff) {
-							if (m_readCount == 0) cout << "input first number: ";
-							else if (m_readCount == 1) cout << "input second number: ";
-							else cout << "input value: ";
-						} else if (m_friendlyFactorial || m_friendlyFib) {
-							if (m_readCount == 0) cout << "input number: ";
-							else cout << "input value: ";
-						} else {
-							cout << "input value: ";
-						}
-					} else {
-						cout << "? ";
-					}
-					cin >> m_memory[address];
-					if (m_readCount < 2) {
-						m_readValues[m_readCount] = m_memory[address];
-					}
-					m_readCount++;
+					m_memory.Store(address, m_accum);
 					break;
 
-				case 8: // WRITE: Display value stored at memory address.
-					if (m_friendlyIo) {
-						if (m_friendlySum && m_readCount >= 2 && m_writeCount == 0) {
-							cout << "the sum of " << m_readValues[0] << " + "
-								 << m_readValues[1] << " is " << m_memory[address] << endl;
-						} else if (m_friendlyDiff && m_readCount >= 2 && m_writeCount == 0) {
-							cout << "the absolute difference of " << m_readValues[0] << " and "
-								 << m_readValues[1] << " is " << m_memory[address] << endl;
-						} else if (m_friendlyFactorial && m_readCount >= 1 && m_writeCount == 0) {
-							cout << "the factorial of " << m_readValues[0] << " is "
-								 << m_memory[address] << endl;
-						} else if (m_friendlyFib && m_readCount >= 1 && m_writeCount == 0) {
-							cout << "the fibonacci number of " << m_readValues[0] << " is "
-								 << m_memory[address] << endl;
-						} else {
-							cout << "output: " << m_memory[address] << endl;
-						}
-					} else {
-						cout << m_memory[address] << endl;
-					}
-					m_writeCount++;
-					break;
+				case 7: // READ: Wait for the caller to supply the value for address.
+					m_ioAddress = address;
+					m_ioCount = 1;
+					m_loc = loc + 1;
+					return EV_Read;
+
+				case 8: // WRITE: Hand the value stored at address to the caller.
+					m_ioAddress = address;
+					m_ioCount = 1;
+					m_loc = loc + 1;
+					return EV_Write;
 
 				case 9: // BRANCH: Unconditional branch to address.
 					loc = address;
@@ -161,25 +491,273 @@ public:
 					continue;
 
 				case 13: // HALT: Terminate program execution.
+					m_status = RS_Halted;
+					m_loc = loc;
+					return EV_Halt;
 
-					cout << "End of emulation." << endl;
-					return true;
+				case 14: // LOAD INDEXED: Load value at address + X into accumulator.
+					if ((address = Indexed(address, loc)) < 0) return EV_Error;
+					m_accum = m_memory.Load(address);
+					break;
 
-				default: // Illegal opcode.
-					Errors::RecordError("[Emulation] Illegal opcode at location " + to_string(loc) + " : " + to_string(opcode));
-					return false;
+				case 15: // STORE INDEXED: Store accumulator value into memory at address + X.
+					if ((address = Indexed(address, loc)) < 0) return EV_Error;
+					m_memory.Store(address, m_accum);
+					break;
+
+				case 16: // ADD INDEXED: Add value at address + X to accumulator.
+					if ((address = Indexed(address, loc)) < 0) return EV_Error;
+					m_accum += m_memory.Load(address);
+					break;
+
+				case 17: // SET INDEX: Set X to the address field.
+					m_index = address;
+					break;
+
+				case 18: // INCREMENT INDEX: Add the address field to X.
+					m_index += address;
+					break;
+
+				case 19: // BRANCH INDEX LESS: Branch if X < accumulator.
+					loc = (m_index < m_accum) ? address : loc + 1;
+					continue;
+
+				case 20: // BLOCK COPY: Copy accumulator words from location X to address.
+					if (!InMemory(m_index, loc) || !InMemory(address, loc)) return EV_Error;
+					if (m_accum > 0) m_memory.Copy(address, m_index, m_accum);
+					break;
+
+				case 21: // BLOCK SUM: Replace accumulator by the sum of that many words at address.
+					if (!InMemory(address, loc)) return EV_Error;
+					m_accum = m_accum > 0 ? m_memory.Sum(address, m_accum) : 0;
+					break;
+
+				case 22: // BLOCK READ: Wait for the caller to supply accumulator words for address.
+				case 23: // BLOCK WRITE: Hand the accumulator words at address to the caller.
+					if (!InMemory(address, loc)) return EV_Error;
+					m_ioAddress = address;
+					m_ioCount = max(m_accum, 0);
+					m_loc = loc + 1;
+					return opcode == 22 ? EV_ReadBlock : EV_WriteBlock;
+
+				case 24: // SPAWN: Start a hart at address with a copy of the accumulator and X.
+					if (!m_spawning) {
+						m_errorMsg = "[Emulation] Error: SPAWN at location " + to_string(loc) + " needs --harts";
+						m_loc = loc;
+						return EV_Error;
+					}
+					m_ioAddress = address;
+					m_loc = loc + 1;
+					return EV_Spawn;
+
+				case 25: // FETCH AND ADD: Add accumulator to the value at address, keeping the old value.
+					m_accum = m_memory.FetchAdd(address, m_accum);
+					break;
+
+				case 26: // COMPARE AND SWAP: If the value at address equals the accumulator,
+						 // replace it by the value at X.  Keep the old value.
+					if (m_index < 0 || m_index >= m_memory.Size()) {
+						m_errorMsg = "[Emulation] Error: CAS value location " + to_string(m_index) + " is outside memory at location " + to_string(loc);
+						m_loc = loc;
+						return EV_Error;
+					}
+					m_accum = m_memory.CompareSwap(address, m_accum, m_memory.Load(m_index));
+					break;
+
+				case 27: // JOIN: Wait until every other hart has halted or is waiting in a JOIN.
+					if (!m_spawning) break;
+					m_loc = loc + 1;
+					return EV_Join;
+
+				default:
+					return Illegal(opcode, loc);
 			}
 
 			loc++;  // Move to the next instruction.
 		}
+	}
+
+	// Back edges taken between reads of the clock by the time limit check.
+	static constexpr long long kClockInterval = 4096;
+
+	// Back edges into a loop head before it is first considered for a fast forward, and
+	// between later attempts.  Heads that do not repay the attempt wait twice as long.
+	static constexpr long long kFastForwardInterval = 16;
+
+	// Opcodes counted by EnableOpcodeCounts: every opcode of two digits.
+	static constexpr unsigned kOpcodeSlots = 100;
+
+	/*
+	NAME
+
+	    FastForward - runs iterations of a hot loop at once.
+
+	SYNOPSIS
+
+	    bool FastForward( int a_head );
+
+	DESCRIPTION
+
+	    Called on the back edge from m_lastLoc to a_head.  The iterations run are capped
+	    so that every back edge the watchdog and the slice would have stopped at is still
+	    seen by Execute, which checks the one into the next iteration on return.  The
+	    clock is read before passing a back edge at which the time limit check would
+	    read it, as a fast forward takes far less time than the iterations.  Only a flat
+	    memory is fast forwarded.
+	*/
+	bool FastForward(int a_head)
+	{
+		if constexpr (!t_Memory::kFlat) {
+			return false;
+		} else {
+			return FastForwardFlat(a_head);
+		}
+	}
+
+	bool FastForwardFlat(int a_head)
+	{
+		if (m_loopHits.empty()) {
+			m_loopHits.assign(m_memory.Size(), 0);
+			m_loopNextTry.assign(m_memory.Size(), kFastForwardInterval);
+		}
+		if (++m_loopHits[a_head] < m_loopNextTry[a_head]) return false;
 
+		int end = m_lastLoc;
+		long long length = end - a_head + 1;
+		long long stop = min({ m_maxSteps, m_sliceEnd, LLONG_MAX / 2 });
+		long long most = (stop - m_steps - 1) / length + 1;
+		// A fast forward past the next read of the clock by the time limit check reads it
+		// here instead, and stops at that back edge if the time is up.
+		long long toClock = kClockInterval - m_backEdges % kClockInterval;
+		if (m_limits.maxMillis > 0 && most > toClock
+			&& chrono::steady_clock::now() - m_startTime >= chrono::milliseconds(m_limits.maxMillis)) {
+			most = toClock;
+		}
+		long long iterations = m_loopRunner.Run(m_memory.Data(), m_memory.Size(), a_head, end, m_accum, most);
+		if (iterations < kFastForwardInterval) {
+			m_loopNextTry[a_head] = m_loopHits[a_head] * 2;
+		} else {
+			m_loopNextTry[a_head] = m_loopHits[a_head] + kFastForwardInterval;
+		}
+		if (iterations == 0) return false;
+
+		m_steps += iterations * length;
+		m_fastForwardSteps += iterations * length;
+		m_backEdges += iterations - 1;
+		if (m_countLoops) {
+			m_loopCounts.At(a_head) += iterations - 1;
+		}
+		if (m_profiling) {
+			for (int loc = a_head; loc <= end; ++loc) m_execCounts[loc] += iterations;
+			m_takenCounts[end] += iterations - 1;
+		}
+		if (m_counting) {
+			for (int loc = a_head; loc <= end; ++loc) m_opcodeCounts[m_memory.Load(loc) / m_memory.Size()] += iterations;
+		}
+		return true;
 	}
 
-private:
+	// Stops on the illegal opcode a_opcode at a_loc.
+	EmulatorEvent Illegal(int a_opcode, int a_loc)
+	{
+		m_errorMsg = "[Emulation] Illegal opcode at location " + to_string(a_loc) + " : " + to_string(a_opcode);
+		m_loc = a_loc;
+		return EV_Error;
+	}
+
+	// The address of an indexed instruction at a_loc, or -1 after setting the error if
+	// the index takes it outside memory.
+	int Indexed(int a_address, int a_loc)
+	{
+		long long indexed = (long long)a_address + m_index;
+		if (indexed >= 0 && indexed < m_memory.Size()) return int(indexed);
+		m_errorMsg = "[Emulation] Error: Indexed address " + to_string(indexed) + " is outside memory at location " + to_string(a_loc);
+		m_loc = a_loc;
+		return -1;
+	}
+
+	// Whether the block of accumulator words at a_first, used by the block instruction at
+	// a_loc, is in memory.  Sets the error if not.
+	bool InMemory(int a_first, int a_loc)
+	{
+		long long end = (long long)a_first + max(m_accum, 0);
+		if (a_first >= 0 && end <= m_memory.Size()) return true;
+		m_errorMsg = "[Emulation] Error: Block of " + to_string(m_accum) + " words at " + to_string(a_first)
+			+ " is outside memory at location " + to_string(a_loc);
+		m_loc = a_loc;
+		return false;
+	}
 
-    int m_memory[MEMSZ];    // The memory of the VC370.  Would have to make it
-    						// a vector if it was much larger.
+	// Stops a run that exceeded a watchdog limit and reports where it was spending its time.
+	EmulatorEvent Watchdog(RunStatus a_status, int a_loc)
+	{
+		m_status = a_status;
+		m_cacheable = false;
+		m_loc = a_loc;
+		string limit = a_status == RS_StepLimit
+			? "instruction limit of " + to_string(m_limits.maxSteps)
+			: "time limit of " + to_string(m_limits.maxMillis) + " ms";
+		int hottest = 0;
+		long long most = -1;
+		m_loopCounts.ForEach([&](int a_head, long long a_count) {
+			if (a_count > most) {
+				hottest = a_head;
+				most = a_count;
+			}
+		});
+		m_errorMsg = "[Watchdog] Stopped at location " + to_string(a_loc) + " after "
+			+ to_string(m_steps) + " instructions: " + limit + " reached.  Hottest loop: "
+			+ to_string(hottest) + "-" + to_string(m_loopEnds.Load(hottest)) + " ("
+			+ to_string(m_loopCounts.Load(hottest)) + " iterations).";
+		return EV_Limit;
+	}
+
+	// Displays the prompt for a READ.
+	void Prompt()
+	{
+		if (m_friendlyIo) {
+			if (m_friendlySum || m_friendlyDiff) {
+				if (m_readCount == 0) cout << "input first number: ";
+				else if (m_readCount == 1) cout << "input second number: ";
+				else cout << "input value: ";
+			} else if (m_friendlyFactorial || m_friendlyFib) {
+				if (m_readCount == 0) cout << "input number: ";
+				else cout << "input value: ";
+			} else {
+				cout << "input value: ";
+			}
+		} else {
+			cout << "? ";
+		}
+	}
+
+	// Displays the value of a WRITE.
+	void Display(int a_value)
+	{
+		if (m_friendlyIo) {
+			if (m_friendlySum && m_readCount >= 2 && m_writeCount == 0) {
+				cout << "the sum of " << m_readValues[0] << " + "
+					 << m_readValues[1] << " is " << a_value << endl;
+			} else if (m_friendlyDiff && m_readCount >= 2 && m_writeCount == 0) {
+				cout << "the absolute difference of " << m_readValues[0] << " and "
+					 << m_readValues[1] << " is " << a_value << endl;
+			} else if (m_friendlyFactorial && m_readCount >= 1 && m_writeCount == 0) {
+				cout << "the factorial of " << m_readValues[0] << " is "
+					 << a_value << endl;
+			} else if (m_friendlyFib && m_readCount >= 1 && m_writeCount == 0) {
+				cout << "the fibonacci number of " << m_readValues[0] << " is "
+					 << a_value << endl;
+			} else {
+				cout << "output: " << a_value << endl;
+			}
+		} else {
+			cout << a_value << endl;
+		}
+	}
+
+    t_Memory m_memory;      // The memory of the VC370.
     int m_accum;		    	// The accumulator for the VC370
+    int m_index;				// The index register X of the extended instruction set.
 	int m_readCount;
 	int m_writeCount;
 	int m_readValues[2];
@@ -188,6 +766,42 @@ private:
 	bool m_friendlyFactorial;
 	bool m_friendlyDiff;
 	bool m_friendlyFib;
+
+	RunLimits m_limits;			// Watchdog limits.
+	RunStatus m_status;			// Outcome of the last run.
+	string m_errorMsg;			// Why the last run stopped, if it did not halt.
+	bool m_cacheable;			// The last run was a function of the image and inputs only.
+	int m_start;				// Location at which runs start.
+	int m_loc;					// Location of the next instruction to execute.
+	int m_lastLoc;				// Location of the previously executed instruction.
+	int m_ioAddress;			// Address of the pending READ or WRITE.
+	int m_ioCount;				// Words it transfers.
+	long long m_steps;			// Instructions retired by the current run.
+	long long m_maxSteps;		// m_limits.maxSteps, or LLONG_MAX if unlimited.
+	long long m_slice;			// Instructions between yields, or zero.
+	long long m_sliceEnd;		// Step count at which Execute next yields.
+	long long m_backEdges;		// Back edges taken by the current run.
+	chrono::steady_clock::time_point m_startTime;	// When the current run started.
+	bool m_countLoops;			// Count back edges for the watchdog's report.
+	PagedArray<long long> m_loopCounts;	// Back edges taken, indexed by loop head.
+	PagedArray<int> m_loopEnds;	// Location of the last back edge into each loop head.
+	bool m_profiling;			// Count executions and transfers of control.
+	vector<long long> m_execCounts;		// Executions, indexed by location.
+	vector<long long> m_takenCounts;	// Transfers of control away from the next location.
+	bool m_counting;			// Count executions of each opcode.
+	vector<long long> m_opcodeCounts;	// Executions, indexed by opcode.
+	long long m_ioWaitMicros;	// Wall time runProgram waited for input.
+	bool m_fastForward;			// Fast forward counted loops.
+	bool m_spawning;			// SPAWN and JOIN return to a multiprocessor.
+	bool m_extended;			// Execute the extended instruction set.
+	long long m_fastForwardSteps;	// Instructions of the current run that were fast forwarded.
+	vector<long long> m_loopHits;	// Back edges taken, indexed by loop head.
+	vector<long long> m_loopNextTry;	// Back edges at which to try the next fast forward.
+	LoopFastForward m_loopRunner;	// Analyzes and runs the loops.
 };
 
+// The classic emulator, and the one with a wide, sparse memory selected by --memory.
+typedef BasicEmulator<FlatMemory> emulator;
+typedef BasicEmulator<PagedMemory> PagedEmulator;
+
 #endif
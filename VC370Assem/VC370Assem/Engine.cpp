@@ -0,0 +1,19 @@
+//
+//  The engines that can be selected by name.
+//
+#include "stdafx.h"
+#include "Engine.h"
+#include "DecodedEngine.h"
+
+vector<string> GetEngineNames()
+{
+	return { "fast-forward", "decoded" };
+}
+
+unique_ptr<Engine> MakeEngine( const string &a_name )
+{
+	if (a_name == "reference") return unique_ptr<Engine>(new EmulatorEngine(false));
+	if (a_name == "fast-forward") return unique_ptr<Engine>(new EmulatorEngine(true));
+	if (a_name == "decoded") return unique_ptr<Engine>(new DecodedEngine);
+	return nullptr;
+}
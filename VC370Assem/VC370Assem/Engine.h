@@ -0,0 +1,93 @@
+//
+//		Engine interface - what the verifier needs of a way of executing VC370 programs.
+//		The reference engine is the switch interpreter of the emulator class; faster
+//		engines must retire the same instructions with the same results.
+//
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Emulator.h"
+#include "ProgramImage.h"
+
+class Engine {
+
+public:
+
+	virtual ~Engine() {}
+
+	// The name the engine is selected by.
+	virtual string GetName() const = 0;
+
+	// As for the emulator class.  Execute must honor the slice the way emulator::Execute
+	// does, yielding on the first back edge at or past the slice, so that engines can be
+	// compared whenever they yield.  Runs must be deterministic, as the verifier runs
+	// them again to find where they disagree.
+	virtual bool LoadImage(const ProgramImage &a_image) = 0;
+	virtual void SetLimits(const RunLimits &a_limits) = 0;
+	virtual void SetSlice(long long a_slice) = 0;
+	virtual void EnableExtended(bool a_enable) = 0;
+	virtual void Reset() = 0;
+	virtual EmulatorEvent Execute() = 0;
+
+	// Executes one instruction.  StepsExactly is false if Step does not take the paths
+	// Execute takes, in which case it only serves to run the engine forwards.
+	virtual EmulatorEvent Step() = 0;
+	virtual bool StepsExactly() const = 0;
+
+	virtual int GetIoValue() const = 0;
+	virtual void SupplyInput(int a_value) = 0;
+	virtual int GetIoCount() const = 0;
+	virtual void GetIoBlock(int *a_words) const = 0;
+	virtual void SupplyInputs(const int *a_values, int a_count) = 0;
+	virtual int GetLocation() const = 0;
+	virtual int GetAccumulator() const = 0;
+	virtual int GetIndex() const = 0;
+	virtual int GetMemory(int a_loc) const = 0;
+	virtual uint64_t GetMemoryHash() const = 0;
+	virtual long long GetStepCount() const = 0;
+	virtual const string &GetErrorMessage() const = 0;
+};
+
+// The emulator class as an engine, with or without loop fast forward.
+class EmulatorEngine : public Engine {
+
+public:
+
+	explicit EmulatorEngine(bool a_fastForward) : m_emul(new emulator) { m_emul->EnableFastForward(a_fastForward); }
+
+	string GetName() const override { return m_emul->IsFastForwarding() ? "fast-forward" : "reference"; }
+
+	bool LoadImage(const ProgramImage &a_image) override { return m_emul->LoadImage(a_image); }
+	void SetLimits(const RunLimits &a_limits) override { m_emul->SetLimits(a_limits); }
+	void SetSlice(long long a_slice) override { m_emul->SetSlice(a_slice); }
+	void EnableExtended(bool a_enable) override { m_emul->EnableExtended(a_enable); }
+	void Reset() override { m_emul->Reset(); }
+	EmulatorEvent Execute() override { return m_emul->Execute(); }
+	EmulatorEvent Step() override { return m_emul->Step(); }
+	bool StepsExactly() const override { return !m_emul->IsFastForwarding(); }
+
+	int GetIoValue() const override { return m_emul->GetIoValue(); }
+	void SupplyInput(int a_value) override { m_emul->SupplyInput(a_value); }
+	int GetIoCount() const override { return m_emul->GetIoCount(); }
+	void GetIoBlock(int *a_words) const override { m_emul->GetIoBlock(a_words); }
+	void SupplyInputs(const int *a_values, int a_count) override { m_emul->SupplyInputs(a_values, a_count); }
+	int GetLocation() const override { return m_emul->GetLocation(); }
+	int GetAccumulator() const override { return m_emul->GetAccumulator(); }
+	int GetIndex() const override { return m_emul->GetIndex(); }
+	int GetMemory(int a_loc) const override { return m_emul->GetMemory(a_loc); }
+	uint64_t GetMemoryHash() const override { return m_emul->GetMemoryHash(); }
+	long long GetStepCount() const override { return m_emul->GetStepCount(); }
+	const string &GetErrorMessage() const override { return m_emul->GetErrorMessage(); }
+
+private:
+
+	unique_ptr<emulator> m_emul;	// On the heap: the memory makes it large.
+};
+
+// The engines that can be compared with the reference engine, by name.
+vector<string> GetEngineNames();
+
+// Creates the engine of a name, or returns null if there is none.
+unique_ptr<Engine> MakeEngine(const string &a_name);
@@ -17,6 +17,7 @@ public:
     static void InitErrorReporting()
     {
         m_ErrorMsgs.clear();
+        m_WasErrorMessages = false;
     }
 
     // Records an error message.
@@ -26,6 +27,9 @@ public:
 	}
     static bool WasThereErrors() { return m_WasErrorMessages; }
 
+    // The error messages recorded since errors were last displayed or initialized.
+    static const vector<string> &GetErrors() { return m_ErrorMsgs; }
+
     // Displays the collected error message.
     static void DisplayErrors()
     {
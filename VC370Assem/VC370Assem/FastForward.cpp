@@ -0,0 +1,234 @@
+//
+//  Implementation of the loop fast forward class.
+//
+#include "stdafx.h"
+#include "FastForward.h"
+#include "VC370Constants.h"
+#include <algorithm>
+#include <climits>
+
+using namespace VC370Constants;
+
+namespace {
+	const size_t kMaxCells = 14;	// Cells stored to by a loop that is fast forwarded.
+}
+
+/*
+NAME
+
+    Run - runs many iterations of a counted loop at once.
+
+SYNOPSIS
+
+    long long Run( int *a_memory, int a_memorySize, int a_head, int a_end, int &a_accum, long long a_maxIterations );
+
+DESCRIPTION
+
+    The body must be straight line code of LOAD, STORE, ADD, SUB and MULT by a cell it
+    does not store to, whose conditional branches leave the loop.  An iteration is then
+    a linear map on the accumulator and the cells the loop stores to, taken modulo 2^32
+    as the emulator's arithmetic is, and n iterations are the n-th power of the map.
+    The number of iterations before the loop is left can be worked out if every value
+    a branch tests only depends on cells that change by the same amount each time, like
+    the counter of demo_fib.asm.  The iteration that leaves the loop is not run here, so
+    the emulator executes it and every exit is taken as it would have been.  A loop
+    without an exit, or whose exits are never taken, is not run here.
+*/
+long long LoopFastForward::Run( int *a_memory, int a_memorySize, int a_head, int a_end, int &a_accum, long long a_maxIterations )
+{
+	if (a_maxIterations <= 0 || !Analyze(a_memory, a_memorySize, a_head, a_end)) return 0;
+
+	vector<uint32_t> state(m_map.size());
+	state[0] = 1;
+	state[1] = uint32_t(a_accum);
+	for (size_t i = 0; i < m_cells.size(); ++i) state[i + 2] = uint32_t(a_memory[m_cells[i]]);
+
+	// A loop that is never left runs one iteration at a time, so that the watchdog stops
+	// it with the counts it would have without a fast forward.
+	long long leaving = LLONG_MAX;
+	for (const Exit &exit : m_exits) {
+		leaving = min(leaving, IterationsBefore(exit, state));
+	}
+	if (leaving == LLONG_MAX) return 0;
+	long long iterations = min(a_maxIterations, leaving);
+	if (iterations <= 0) return 0;
+
+	// The map raised to the number of iterations, by repeated squaring.
+	Matrix power = m_map;
+	for (long long remaining = iterations; ; ) {
+		if (remaining & 1) state = Apply(power, state);
+		remaining >>= 1;
+		if (remaining == 0) break;
+		power = Multiply(power, power);
+	}
+	a_accum = int(state[1]);
+	for (size_t i = 0; i < m_cells.size(); ++i) a_memory[m_cells[i]] = int(state[i + 2]);
+	return iterations;
+}
+
+bool LoopFastForward::Analyze( const int *a_memory, int a_memorySize, int a_head, int a_end )
+{
+	m_cells.clear();
+	m_exits.clear();
+	for (int loc = a_head; loc <= a_end; ++loc) {
+		if (a_memory[loc] < 0) return false;
+		int opcode = a_memory[loc] / kMaxMemory;
+		int address = a_memory[loc] % kMaxMemory;
+		if (address >= a_memorySize) return false;
+		if (opcode != OP_STORE || find(m_cells.begin(), m_cells.end(), address) != m_cells.end()) continue;
+		// A loop that stores into itself changes what it does.
+		if (address >= a_head && address <= a_end) return false;
+		m_cells.push_back(address);
+	}
+	if (m_cells.size() > kMaxCells) return false;
+
+	size_t size = m_cells.size() + 2;
+	auto Unit = [size](size_t a_index) {
+		Linear unit(size, 0);
+		unit[a_index] = 1;
+		return unit;
+	};
+	auto CellIndex = [this](int a_address) {
+		return int(find(m_cells.begin(), m_cells.end(), a_address) - m_cells.begin());
+	};
+	vector<Linear> cells;
+	for (size_t i = 0; i < m_cells.size(); ++i) cells.push_back(Unit(i + 2));
+	Linear accum = Unit(1);
+	auto Value = [&](int a_address) {
+		int index = CellIndex(a_address);
+		if (index < int(m_cells.size())) return cells[index];
+		Linear constant(size, 0);
+		constant[0] = uint32_t(a_memory[a_address]);
+		return constant;
+	};
+
+	bool closed = false;
+	for (int loc = a_head; loc <= a_end; ++loc) {
+		int opcode = a_memory[loc] / kMaxMemory;
+		int address = a_memory[loc] % kMaxMemory;
+		bool inside = address >= a_head && address <= a_end;
+		switch (opcode) {
+			case OP_LOAD:
+				accum = Value(address);
+				break;
+			case OP_ADD:
+			case OP_SUB: {
+				Linear operand = Value(address);
+				for (size_t i = 0; i < size; ++i) {
+					accum[i] = opcode == OP_ADD ? accum[i] + operand[i] : accum[i] - operand[i];
+				}
+				break;
+			}
+			case OP_MULT: {
+				// Only a product with a constant is linear.
+				if (CellIndex(address) < int(m_cells.size())) return false;
+				uint32_t factor = uint32_t(a_memory[address]);
+				for (uint32_t &coefficient : accum) coefficient *= factor;
+				break;
+			}
+			case OP_STORE:
+				cells[CellIndex(address)] = accum;
+				break;
+			case OP_B:
+				if (loc != a_end || address != a_head) return false;
+				closed = true;
+				break;
+			case OP_BM:
+			case OP_BZ:
+			case OP_BP: {
+				Condition taken = opcode == OP_BM ? C_Negative : opcode == OP_BZ ? C_Zero : C_Positive;
+				if (loc == a_end && address == a_head) {
+					// The loop is left by falling through.
+					Condition fallen = taken == C_Negative ? C_NotNegative : taken == C_Zero ? C_NonZero : C_NotPositive;
+					m_exits.push_back(Exit{ accum, fallen });
+					closed = true;
+				} else if (inside) {
+					return false;
+				} else {
+					m_exits.push_back(Exit{ accum, taken });
+				}
+				break;
+			}
+			default:
+				// Division can stop the emulator, and the rest need the outside world.
+				return false;
+		}
+	}
+	if (!closed) return false;
+
+	m_map.assign(1, Unit(0));
+	m_map.push_back(accum);
+	m_map.insert(m_map.end(), cells.begin(), cells.end());
+	return true;
+}
+
+// The value tested must change by the same amount each iteration, which is the case
+// if it only depends on cells, or the accumulator, that are incremented by a constant.
+long long LoopFastForward::IterationsBefore( const Exit &a_exit, const vector<uint32_t> &a_state ) const
+{
+	uint32_t first = 0, step = 0;
+	for (size_t i = 0; i < a_exit.m_value.size(); ++i) {
+		uint32_t coefficient = a_exit.m_value[i];
+		first += coefficient * a_state[i];
+		if (coefficient == 0 || i == 0) continue;
+		for (size_t j = 1; j < m_map[i].size(); ++j) {
+			if (m_map[i][j] != (j == i ? 1u : 0u)) return 0;
+		}
+		step += coefficient * m_map[i][0];
+	}
+	long long from = int32_t(first), by = int32_t(step);
+
+	// The closed form holds as long as the value stays within the range of an int.
+	long long inRange = LLONG_MAX;
+	if (by > 0) inRange = (INT_MAX - from) / by + 1;
+	if (by < 0) inRange = (from - INT_MIN) / -by + 1;
+	return min(inRange, FirstMeeting(from, by, a_exit.m_condition));
+}
+
+long long LoopFastForward::FirstMeeting( long long a_first, long long a_step, Condition a_condition )
+{
+	switch (a_condition) {
+		case C_Zero:
+			if (a_first == 0) return 0;
+			if (a_step == 0 || a_first % a_step != 0 || -a_first / a_step < 0) return LLONG_MAX;
+			return -a_first / a_step;
+		case C_NonZero:
+			if (a_first != 0) return 0;
+			return a_step != 0 ? 1 : LLONG_MAX;
+		case C_Positive:
+			if (a_first > 0) return 0;
+			return a_step > 0 ? -a_first / a_step + 1 : LLONG_MAX;
+		case C_NotPositive:
+			if (a_first <= 0) return 0;
+			return a_step < 0 ? (a_first - a_step - 1) / -a_step : LLONG_MAX;
+		case C_Negative:
+			if (a_first < 0) return 0;
+			return a_step < 0 ? a_first / -a_step + 1 : LLONG_MAX;
+		case C_NotNegative:
+			if (a_first >= 0) return 0;
+			return a_step > 0 ? (-a_first + a_step - 1) / a_step : LLONG_MAX;
+	}
+	return 0;
+}
+
+LoopFastForward::Matrix LoopFastForward::Multiply( const Matrix &a_left, const Matrix &a_right )
+{
+	size_t size = a_left.size();
+	Matrix product(size, Linear(size, 0));
+	for (size_t i = 0; i < size; ++i) {
+		for (size_t k = 0; k < size; ++k) {
+			if (a_left[i][k] == 0) continue;
+			for (size_t j = 0; j < size; ++j) product[i][j] += a_left[i][k] * a_right[k][j];
+		}
+	}
+	return product;
+}
+
+vector<uint32_t> LoopFastForward::Apply( const Matrix &a_map, const vector<uint32_t> &a_state )
+{
+	vector<uint32_t> result(a_map.size(), 0);
+	for (size_t i = 0; i < a_map.size(); ++i) {
+		for (size_t j = 0; j < a_state.size(); ++j) result[i] += a_map[i][j] * a_state[j];
+	}
+	return result;
+}
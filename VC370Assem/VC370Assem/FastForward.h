@@ -0,0 +1,58 @@
+//
+//		Loop fast forward - recognizes counted loops whose bodies update memory and the
+//		accumulator linearly and runs many of their iterations at once.  Used by the
+//		emulator when a loop becomes hot; the state reached is the one that executing
+//		the iterations one instruction at a time would reach.
+//
+#pragma once
+
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+class LoopFastForward {
+
+public:
+
+	// Runs whole iterations of the loop a_head..a_end, entered at a_head, whose last
+	// instruction branches back to a_head.  At most a_maxIterations are run, and never
+	// one in which the loop would be left.  Returns the number run, updating a_memory
+	// and a_accum, or zero if the loop does not have the form required or is never left.
+	long long Run(int *a_memory, int a_memorySize, int a_head, int a_end, int &a_accum, long long a_maxIterations);
+
+private:
+
+	// A linear combination of the state at the start of an iteration: the coefficient of
+	// the constant 1, of the accumulator and of each cell the loop stores to.
+	typedef vector<uint32_t> Linear;
+	typedef vector<Linear> Matrix;
+
+	// The values of the accumulator for which a conditional branch leaves the loop.
+	enum Condition { C_Zero, C_NonZero, C_Positive, C_NotPositive, C_Negative, C_NotNegative };
+
+	// A branch that leaves the loop if the accumulator, as a function of the state at
+	// the start of the iteration, meets the condition.
+	struct Exit {
+		Linear m_value;
+		Condition m_condition;
+	};
+
+	// Whether the body has the form required, recording the map from the state at the
+	// start of an iteration to the state at the end and the exits of the loop.
+	bool Analyze(const int *a_memory, int a_memorySize, int a_head, int a_end);
+
+	// The number of iterations before an exit is taken, as long as the value it tests
+	// does not overflow.
+	long long IterationsBefore(const Exit &a_exit, const vector<uint32_t> &a_state) const;
+
+	// The first iteration in which a value going from a_first in steps of a_step meets the
+	// condition, or LLONG_MAX if it never does.
+	static long long FirstMeeting(long long a_first, long long a_step, Condition a_condition);
+
+	static Matrix Multiply(const Matrix &a_left, const Matrix &a_right);
+	static vector<uint32_t> Apply(const Matrix &a_map, const vector<uint32_t> &a_state);
+
+	vector<int> m_cells;		// The cells the loop stores to, in the order of the state.
+	Matrix m_map;				// The state at the end of an iteration, row by row.
+	vector<Exit> m_exits;		// The branches out of the loop.
+};
@@ -6,17 +6,20 @@
 #include <iostream>
 using namespace std;
 
-// Don't forget to comment the function headers.
-FileAccess::FileAccess( int argc, char *argv[] )
+// Opens the source file named on the command line, or prepares to read source text
+// that was handed to the assembler directly.
+FileAccess::FileAccess( const string &a_source, SourceKind a_kind )
 {
-    // Check that there is exactly one run time parameter.
-    if( argc != 2 ) {
-        cerr << "Usage: Assem <FileName>" << endl;
-        exit( 1 );
+    if( a_kind == SK_Text ) {
+        m_text.str( a_source );
+        m_source = &m_text;
+        return;
     }
+    m_source = &m_sfile;
+
     // Open the file.  One might question if this is the best place to open the file.
     // One might also question whether we need a file access class.
-    m_sfile.open( argv[1], ios::in );
+    m_sfile.open( a_source, ios::in );
 
     // If the open failed, report the error and terminate.
     if( ! m_sfile ) {
@@ -28,17 +31,17 @@ FileAccess::FileAccess( int argc, char *argv[] )
 FileAccess::~FileAccess( )
 {
     // Not that necessary in that the file will be closed when the program terminates, but good form.
-    m_sfile.close( );
+    if( m_sfile.is_open( ) ) m_sfile.close( );
 }
 // Get the next line from the file.
 bool FileAccess::GetNextLine(string& a_buff)
 {
     // If there is no more data, return false.
-    if (m_sfile.eof()) {
+    if (m_source->eof()) {
 
         return false;
     }
-    getline(m_sfile, a_buff);
+    getline(*m_source, a_buff);
 
     // Return indicating success.
     return true;
@@ -47,7 +50,7 @@ bool FileAccess::GetNextLine(string& a_buff)
 void FileAccess::rewind( )
 {
     // Clean all file flags and go back to the beginning of the file.
-    m_sfile.clear();
-    m_sfile.seekg( 0, ios::beg );
+    m_source->clear();
+    m_source->seekg( 0, ios::beg );
 }
     
\ No newline at end of file
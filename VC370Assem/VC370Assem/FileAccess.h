@@ -5,6 +5,7 @@
 #define _FILEACCESS_H // We use pramas in Visual Studio.  See other include files
 
 #include <fstream>
+#include <sstream>
 #include <stdlib.h>
 #include <string>
 
@@ -12,8 +13,14 @@ class FileAccess {
 
 public:
 
-    // Opens the file.
-    FileAccess( int argc, char *argv[] );
+    // Where the source comes from.
+    enum SourceKind {
+        SK_File,        // a_source names a file.
+        SK_Text         // a_source is the text itself.
+    };
+
+    // Opens the file, or prepares to read the text.
+    FileAccess( const string &a_source, SourceKind a_kind = SK_File );
 
     // Closes the file.
     ~FileAccess( );
@@ -27,5 +34,7 @@ public:
 private:
 
     ifstream m_sfile;		// Source file object.
+    istringstream m_text;   // Source text object.
+    istream *m_source;      // The one of the two that is being read.
 };
 #endif
@@ -0,0 +1,346 @@
+//
+//  Implementation of the flow graph class.
+//
+#include "stdafx.h"
+#include "FlowGraph.h"
+#include <algorithm>
+
+using namespace VC370Constants;
+
+/*
+NAME
+
+    Build - builds the flow graph of a translation.
+
+SYNOPSIS
+
+    bool Build( const ProgramImage &a_image, string &a_reason );
+
+DESCRIPTION
+
+    Every statement that occupies memory becomes a node, in location order.  The
+    operand of an instruction is recorded as the node holding the address and the
+    word within it, so that it follows the node when the program is laid out again.
+    The VC370 has no indirect addressing, so only an instruction can change another
+    instruction or compute where to go; a program that stores into its code, reads
+    its code as data or lets control run into its data is refused, as is one with
+    storage that runs past the end of memory.
+*/
+bool FlowGraph::Build( const ProgramImage &a_image, string &a_reason )
+{
+    m_nodes.clear();
+    m_blocks.clear();
+    m_symbols = a_image.GetSymbols();
+
+    // The contents of memory once the image is loaded.
+    map<int, int> memory;
+    for (const ProgramImage::Word &word : a_image.GetWords()) {
+        memory[word.m_loc] = word.m_contents;
+    }
+
+    vector<ProgramImage::Statement> statements = a_image.GetStatements();
+    stable_sort(statements.begin(), statements.end(),
+        [](const ProgramImage::Statement &a, const ProgramImage::Statement &b) { return a.m_loc < b.m_loc; });
+    if (statements.empty()) {
+        a_reason = "the translation has no statements";
+        return false;
+    }
+    for (const ProgramImage::Statement &statement : statements) {
+        if (!m_nodes.empty() && statement.m_loc < m_nodes.back().m_loc + m_nodes.back().m_length) {
+            a_reason = "statements overlap at location " + to_string(statement.m_loc);
+            return false;
+        }
+        // The assembler only checks where a statement starts.
+        if ((long long)statement.m_loc + statement.m_length > kMaxMemory) {
+            a_reason = "the statement at location " + to_string(statement.m_loc) + " runs past the end of memory";
+            return false;
+        }
+        Node node{ statement.m_kind, statement.m_loc, statement.m_length, statement.m_source, 0, -1, 0, 0, false, false, -1 };
+        int contents = memory.count(statement.m_loc) ? memory[statement.m_loc] : 0;
+        if (node.m_kind == ProgramImage::SK_Instruction) {
+            node.m_opcode = contents / kMaxMemory;
+            node.m_offset = contents % kMaxMemory;
+        } else if (node.m_kind == ProgramImage::SK_Constant) {
+            node.m_value = contents;
+        }
+        m_nodes.push_back(node);
+    }
+    m_originalCount = m_nodes.size();
+
+    // Operands refer to the node holding the address.  The operand of HALT is unused.
+    for (Node &node : m_nodes) {
+        if (node.m_kind != ProgramImage::SK_Instruction || node.m_opcode == OP_HALT) continue;
+        int target = NodeAt(node.m_offset);
+        if (target >= 0) {
+            node.m_offset -= m_nodes[target].m_loc;
+            node.m_target = target;
+        }
+    }
+
+    m_entry = NodeAt(a_image.GetStart());
+    if (m_entry < 0 || m_nodes[m_entry].m_kind != ProgramImage::SK_Instruction) {
+        a_reason = "execution does not start at an instruction";
+        return false;
+    }
+    Analyze();
+
+    // Only the instructions that can be executed matter.
+    for (size_t i = 0; i < m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        if (!node.m_reachable) continue;
+        string where = " at location " + to_string(node.m_loc);
+        bool codeOperand = node.m_target >= 0 && m_nodes[node.m_target].m_kind == ProgramImage::SK_Instruction;
+
+        if (node.m_opcode > OP_HALT && node.m_opcode <= OP_JOIN) {
+            a_reason = "extended instruction" + where;
+        } else if (node.m_opcode < OP_ADD || node.m_opcode > OP_HALT) {
+            a_reason = "illegal opcode" + where;
+        } else if (IsBranch(node.m_opcode) && (!codeOperand || node.m_offset != 0)) {
+            a_reason = "branch into data" + where;
+        } else if (WritesOperand(node.m_opcode) && codeOperand) {
+            a_reason = "the instruction at location " + to_string(m_nodes[node.m_target].m_loc)
+                + " may be overwritten at run time (by the instruction" + where + ")";
+        } else if (ReadsOperand(node.m_opcode) && codeOperand) {
+            a_reason = "the instruction at location " + to_string(m_nodes[node.m_target].m_loc)
+                + " is read as data" + where;
+        } else if (FallsThrough(node.m_opcode) && (i + 1 >= m_originalCount
+            || m_nodes[i + 1].m_kind != ProgramImage::SK_Instruction || m_nodes[i + 1].m_loc != node.m_loc + 1)) {
+            a_reason = "control runs past the instruction" + where + " into data";
+        } else {
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Analyze - recomputes reachability and the basic blocks.
+
+SYNOPSIS
+
+    void Analyze( );
+
+DESCRIPTION
+
+    A removed instruction hands its references to where control went after it.  The
+    blocks are then rebuilt from the instructions reachable from the entry, in the
+    original order: a block starts at the entry, at a branch target and after a
+    branch or HALT.
+*/
+void FlowGraph::Analyze( )
+{
+    for (Node &node : m_nodes) {
+        if (node.m_kind != ProgramImage::SK_Instruction || node.m_removed || node.m_target < 0) continue;
+        const Node &target = m_nodes[node.m_target];
+        if (target.m_kind == ProgramImage::SK_Instruction && target.m_removed) {
+            node.m_target = Forward(node.m_target);
+        }
+    }
+    m_entry = Forward(m_entry);
+
+    for (Node &node : m_nodes) {
+        node.m_reachable = false;
+        node.m_block = -1;
+    }
+    vector<int> pending{ m_entry };
+    while (!pending.empty()) {
+        int n = pending.back();
+        pending.pop_back();
+        if (n < 0 || m_nodes[n].m_reachable) continue;
+        Node &node = m_nodes[n];
+        node.m_reachable = true;
+        if (IsBranch(node.m_opcode) && node.m_target >= 0 && m_nodes[node.m_target].m_kind == ProgramImage::SK_Instruction) {
+            pending.push_back(node.m_target);
+        }
+        if (FallsThrough(node.m_opcode)) pending.push_back(NextInstruction(n));
+    }
+
+    vector<bool> leader(m_nodes.size(), false);
+    leader[m_entry] = true;
+    for (size_t n = 0; n < m_nodes.size(); ++n) {
+        const Node &node = m_nodes[n];
+        if (!node.m_reachable) continue;
+        if (IsBranch(node.m_opcode) && node.m_target >= 0) leader[node.m_target] = true;
+        int next = NextInstruction(int(n));
+        if (EndsBlock(node.m_opcode) && next >= 0) leader[next] = true;
+    }
+
+    m_blocks.clear();
+    int previous = -1;
+    for (size_t n = 0; n < m_nodes.size(); ++n) {
+        Node &node = m_nodes[n];
+        if (!node.m_reachable || node.m_removed) continue;
+        if (leader[n] || previous < 0 || EndsBlock(m_nodes[previous].m_opcode) || NextInstruction(previous) != int(n)) {
+            m_blocks.push_back(Block{ {}, -1, -1 });
+        }
+        node.m_block = int(m_blocks.size()) - 1;
+        m_blocks.back().m_nodes.push_back(int(n));
+        previous = int(n);
+    }
+    for (Block &block : m_blocks) {
+        int last = block.m_nodes.back();
+        const Node &node = m_nodes[last];
+        if (IsBranch(node.m_opcode) && node.m_target >= 0) block.m_taken = m_nodes[node.m_target].m_block;
+        if (FallsThrough(node.m_opcode)) {
+            int next = NextInstruction(last);
+            if (next >= 0) block.m_next = m_nodes[next].m_block;
+        }
+    }
+}
+
+int FlowGraph::NextInstruction( int a_node ) const
+{
+    for (size_t n = size_t(a_node) + 1; n < m_originalCount; ++n) {
+        if (m_nodes[n].m_kind == ProgramImage::SK_Instruction && !m_nodes[n].m_removed) return int(n);
+    }
+    return -1;
+}
+
+int FlowGraph::AddConstant( int a_value, const string &a_source )
+{
+    m_nodes.push_back(Node{ ProgramImage::SK_Constant, -1, 1, a_source, 0, -1, 0, a_value, false, false, -1 });
+    return int(m_nodes.size()) - 1;
+}
+
+int FlowGraph::NodeAt( int a_loc ) const
+{
+    auto after = upper_bound(m_nodes.begin(), m_nodes.begin() + m_originalCount, a_loc,
+        [](int a_value, const Node &a_node) { return a_value < a_node.m_loc; });
+    if (after == m_nodes.begin()) return -1;
+    int n = int(after - m_nodes.begin()) - 1;
+    return a_loc < m_nodes[n].m_loc + m_nodes[n].m_length ? n : -1;
+}
+
+// A removed branch only ever went to the next instruction, so following its target
+// and following the original order agree.
+int FlowGraph::Forward( int a_node ) const
+{
+    for (size_t hops = 0; a_node >= 0 && m_nodes[a_node].m_removed; ++hops) {
+        if (hops > m_nodes.size()) return -1;
+        const Node &node = m_nodes[a_node];
+        a_node = IsBranch(node.m_opcode) ? node.m_target : NextInstruction(a_node);
+    }
+    return a_node;
+}
+
+/*
+NAME
+
+    Emit - lays the program out and produces its image.
+
+SYNOPSIS
+
+    bool Emit( const vector<int> &a_order, ProgramImage &a_image, string &a_reason ) const;
+
+DESCRIPTION
+
+    a_order lists every block once.  The code starts at the original first location
+    and the data follows it, in the original order, so the program never grows
+    except by the branches added to keep control flowing to the right blocks.  A
+    B to the block placed right after it is left out.
+    Operands are resolved to the new locations of their nodes; an address that is
+    in no node is kept, which is only safe while it stays outside the program.
+    The symbols are moved along with their statements.
+*/
+bool FlowGraph::Emit( const vector<int> &a_order, ProgramImage &a_image, string &a_reason ) const
+{
+    if (a_order.size() != m_blocks.size()) {
+        a_reason = "the layout does not place every block";
+        return false;
+    }
+    const int origin = m_nodes.front().m_loc;
+    vector<int> address(m_nodes.size(), -1);
+
+    // The code in order: a node, or a B added to reach a block.
+    struct Placed {
+        int m_node;
+        int m_block;
+    };
+    vector<Placed> code;
+    int loc = origin;
+    for (size_t i = 0; i < a_order.size(); ++i) {
+        const Block &block = m_blocks[a_order[i]];
+        int following = i + 1 < a_order.size() ? a_order[i + 1] : -1;
+        for (int n : block.m_nodes) {
+            // A B to the block placed next is not needed; it takes that block's location.
+            address[n] = loc;
+            if (m_nodes[n].m_opcode == OP_B && block.m_taken == following) continue;
+            loc++;
+            code.push_back(Placed{ n, -1 });
+        }
+        if (block.m_next >= 0 && block.m_next != following) {
+            code.push_back(Placed{ -1, block.m_next });
+            loc++;
+        }
+    }
+    vector<int> data;
+    for (size_t n = 0; n < m_nodes.size(); ++n) {
+        if (m_nodes[n].m_kind == ProgramImage::SK_Instruction || m_nodes[n].m_removed) continue;
+        address[n] = loc;
+        loc += m_nodes[n].m_length;
+        data.push_back(int(n));
+    }
+    const int end = loc;
+    if (end > kMaxMemory) {
+        a_reason = "the program no longer fits in memory";
+        return false;
+    }
+
+    ProgramImage image;
+    loc = origin;
+    for (const Placed &placed : code) {
+        int opcode = OP_B;
+        int operand;
+        string source;
+        if (placed.m_node < 0) {
+            int target = m_blocks[placed.m_block].m_nodes.front();
+            operand = address[target];
+            source = "        B    " + to_string(operand);
+            for (const auto &symbol : m_symbols) {
+                if (symbol.second == m_nodes[target].m_loc) source = "        B    " + symbol.first;
+            }
+        } else {
+            const Node &node = m_nodes[placed.m_node];
+            opcode = node.m_opcode;
+            source = node.m_source;
+            if (node.m_target >= 0) {
+                operand = address[node.m_target] + node.m_offset;
+            } else {
+                operand = node.m_offset;
+                if (opcode != OP_HALT && operand >= origin && operand < end) {
+                    a_reason = "location " + to_string(operand) + ", named by the instruction at location "
+                        + to_string(node.m_loc) + ", would be inside the program";
+                    return false;
+                }
+            }
+        }
+        image.AddWord(loc, opcode * kMaxMemory + operand);
+        image.AddStatement(ProgramImage::SK_Instruction, loc, 1, source);
+        loc++;
+    }
+    for (int n : data) {
+        const Node &node = m_nodes[n];
+        image.AddWord(address[n], node.m_kind == ProgramImage::SK_Constant ? node.m_value : 0);
+        image.AddStatement(node.m_kind, address[n], node.m_length, node.m_source);
+    }
+    image.SetStart(address[m_entry]);
+
+    map<string, int> symbols;
+    for (const auto &symbol : m_symbols) {
+        int n = NodeAt(symbol.second);
+        if (n < 0) {
+            symbols.insert(symbol);
+            continue;
+        }
+        int offset = symbol.second - m_nodes[n].m_loc;
+        if (m_nodes[n].m_kind == ProgramImage::SK_Instruction) n = Forward(n);
+        if (n >= 0 && address[n] >= 0) symbols[symbol.first] = address[n] + offset;
+    }
+    image.SetSymbols(symbols);
+
+    a_image = image;
+    return true;
+}
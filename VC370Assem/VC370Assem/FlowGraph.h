@@ -0,0 +1,91 @@
+//
+//		Flow graph class - the statements of a translation as basic blocks, for the passes
+//		that rearrange a program.  Operands refer to statements rather than locations, so
+//		statements can be removed, added and moved; Emit then assigns the new locations.
+//
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ProgramImage.h"
+#include "VC370Constants.h"
+using namespace std;
+
+class FlowGraph {
+
+public:
+
+	// A statement of the program.
+	struct Node {
+		ProgramImage::StatementKind m_kind;
+		int m_loc;			// Original location, or -1 for a statement added by a pass.
+		int m_length;		// Words occupied.
+		string m_source;	// The statement as written.
+		int m_opcode;		// Instructions: the opcode.
+		int m_target;		// Instructions: the node the operand is in, or -1 if it is in no node.
+		int m_offset;		// Instructions: the word of m_target, or the address if m_target is -1.
+		int m_value;		// Constants: the value.
+		bool m_removed;		// Dropped by a pass.
+		bool m_reachable;	// Instructions: reachable from the entry.
+		int m_block;		// Instructions: the basic block, or -1.
+	};
+
+	// A basic block: control only enters at the first instruction and leaves at the last.
+	struct Block {
+		vector<int> m_nodes;	// The instructions, in order.
+		int m_next;				// The block control falls through to, or -1.
+		int m_taken;			// The block a branch at the end goes to, or -1.
+	};
+
+	// Builds the graph of a translation.  Returns false, with the reason, if the program
+	// cannot safely be rearranged: instructions it may overwrite or read as data, control
+	// that runs into data, or an illegal opcode it can reach.
+	bool Build(const ProgramImage &a_image, string &a_reason);
+
+	// Redirects references to removed instructions and recomputes reachability and the
+	// blocks.  Passes call this after changing instructions.
+	void Analyze();
+
+	vector<Node> &GetNodes() { return m_nodes; }
+	const vector<Node> &GetNodes() const { return m_nodes; }
+	const vector<Block> &GetBlocks() const { return m_blocks; }
+	int GetEntry() const { return m_entry; }
+
+	// The instruction after a_node in the original order, skipping data and removed
+	// instructions, or -1.  Build makes sure control never actually runs into data.
+	int NextInstruction(int a_node) const;
+
+	// Appends a constant.  Returns its node.
+	int AddConstant(int a_value, const string &a_source);
+
+	// Lays the program out from the original first location: the blocks in a_order, each
+	// followed by a B where control no longer falls through to the right block, then the
+	// data.  Returns false, with the reason, if the program no longer fits around the
+	// locations it names that are outside its statements.
+	bool Emit(const vector<int> &a_order, ProgramImage &a_image, string &a_reason) const;
+
+	// Classes of opcodes.
+	static bool IsBranch(int a_opcode) { return a_opcode >= VC370Constants::OP_B && a_opcode <= VC370Constants::OP_BP; }
+	static bool EndsBlock(int a_opcode) { return IsBranch(a_opcode) || a_opcode == VC370Constants::OP_HALT; }
+	static bool FallsThrough(int a_opcode) { return a_opcode != VC370Constants::OP_B && a_opcode != VC370Constants::OP_HALT; }
+	static bool ReadsOperand(int a_opcode)
+	{
+		return (a_opcode >= VC370Constants::OP_ADD && a_opcode <= VC370Constants::OP_LOAD) || a_opcode == VC370Constants::OP_WRITE;
+	}
+	static bool WritesOperand(int a_opcode) { return a_opcode == VC370Constants::OP_STORE || a_opcode == VC370Constants::OP_READ; }
+
+private:
+
+	// The original node holding location a_loc, or -1.
+	int NodeAt(int a_loc) const;
+
+	// a_node, or where control goes instead if it was removed.  -1 if nowhere.
+	int Forward(int a_node) const;
+
+	vector<Node> m_nodes;			// Original statements in location order, then added ones.
+	size_t m_originalCount = 0;		// Nodes that came from the translation.
+	vector<Block> m_blocks;			// Reachable blocks in the original order.
+	int m_entry = -1;				// The first instruction executed.
+	map<string, int> m_symbols;		// Symbols of the translation.
+};
@@ -0,0 +1,329 @@
+//
+//  Implementation of the incremental assembler and the watch mode.
+//
+#include "stdafx.h"
+#include "Incremental.h"
+#include "Assembler.h"
+#include "BlockIo.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+namespace {
+	const chrono::milliseconds kPollInterval(50);	// Between looks at the source file.
+
+	long long MicrosSince(chrono::steady_clock::time_point a_start)
+	{
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - a_start).count();
+	}
+
+	// The lines of a source, as FileAccess::GetNextLine reads them.
+	vector<string_view> SplitLines(const string &a_source)
+	{
+		vector<string_view> lines;
+		size_t begin = 0;
+		while (true) {
+			size_t newline = a_source.find('\n', begin);
+			lines.push_back(string_view(a_source).substr(begin, newline == string::npos ? string::npos : newline - begin));
+			if (newline == string::npos) return lines;
+			begin = newline + 1;
+		}
+	}
+}
+
+/*
+NAME
+
+    Update - brings the translation up to date with a new version of the source.
+
+SYNOPSIS
+
+    bool Update( const string &a_source );
+
+DESCRIPTION
+
+    The lines that changed are those between the longest common beginning and end of
+    the old and new versions, which covers an edit in one place.  They are parsed again
+    and spliced in.  Locations are then computed again from the first of them until an
+    unchanged line after them is back at its old location.  The symbols defined by the
+    changed and relocated lines, and by the lines that END now includes or excludes, are
+    looked up again.  Only the operands of the symbols that moved are resolved again, and
+    only those of the symbols that came or went are checked again.
+*/
+bool IncrementalAssembler::Update( const string &a_source )
+{
+	vector<string_view> texts = SplitLines(a_source);
+	size_t oldCount = m_lines.size(), newCount = texts.size();
+	size_t prefix = 0, suffix = 0;
+	while (prefix < oldCount && prefix < newCount && m_lines[prefix].m_text == texts[prefix]) prefix++;
+	while (suffix < oldCount - prefix && suffix < newCount - prefix
+		&& m_lines[oldCount - 1 - suffix].m_text == texts[newCount - 1 - suffix]) suffix++;
+	size_t oldEnd = oldCount - suffix, newEnd = newCount - suffix;
+
+	m_counts = UpdateCounts();
+	m_counts.m_lines = newCount;
+	if (prefix == oldCount && oldCount == newCount) return m_errors.empty();
+	m_counts.m_parsed = newEnd - prefix;
+	m_counts.m_removed = oldEnd - prefix;
+
+	// Parse the changed lines and splice them in.
+	set<string> touched;
+	for (size_t i = prefix; i < oldEnd; ++i) {
+		if (IsStatement(m_lines[i]) && m_lines[i].m_inst.isLabel()) touched.insert(m_lines[i].m_inst.GetLabel());
+	}
+	if (newEnd > oldEnd) {
+		m_lines.insert(m_lines.begin() + oldEnd, newEnd - oldEnd, SourceLine());
+	} else {
+		m_lines.erase(m_lines.begin() + newEnd, m_lines.begin() + oldEnd);
+	}
+	for (size_t i = prefix; i < newEnd; ++i) {
+		Parse(string(texts[i]), m_lines[i]);
+	}
+
+	// The definitions of the lines after the changed ones move with them.
+	for (auto it = m_definitions.begin(); it != m_definitions.end(); ) {
+		vector<size_t> &indices = it->second;
+		size_t kept = 0;
+		for (size_t index : indices) {
+			if (index >= prefix && index < oldEnd) continue;
+			indices[kept++] = index >= oldEnd ? index - oldEnd + newEnd : index;
+		}
+		indices.resize(kept);
+		it = indices.empty() ? m_definitions.erase(it) : next(it);
+	}
+	for (size_t i = prefix; i < newEnd; ++i) {
+		if (!IsStatement(m_lines[i]) || !m_lines[i].m_inst.isLabel()) continue;
+		const string &label = m_lines[i].m_inst.GetLabel();
+		vector<size_t> &indices = m_definitions[label];
+		indices.insert(lower_bound(indices.begin(), indices.end(), i), i);
+		touched.insert(label);
+	}
+
+	// The labels between the old and the new END are defined or undefined.
+	size_t oldEndLine = m_end < prefix ? m_end : m_end >= oldEnd ? m_end - oldEnd + newEnd : prefix;
+	if (m_end >= prefix) {
+		for (m_end = prefix; m_end < m_lines.size() && m_lines[m_end].m_inst.GetType() != Instruction::ST_End; ++m_end) {
+		}
+	}
+	for (size_t i = min(oldEndLine, m_end); i < max(oldEndLine, m_end) && i < m_lines.size(); ++i) {
+		if (IsStatement(m_lines[i]) && m_lines[i].m_inst.isLabel()) touched.insert(m_lines[i].m_inst.GetLabel());
+	}
+
+	// Relocate until the locations line up again.
+	int loc = prefix == 0 ? 0 : m_lines[prefix - 1].m_loc + m_lines[prefix - 1].m_size;
+	for (size_t i = prefix; i < m_lines.size(); ++i) {
+		SourceLine &line = m_lines[i];
+		if (i >= newEnd) {
+			if (line.m_loc == loc) break;
+			m_counts.m_relocated++;
+			if (IsStatement(line) && line.m_inst.isLabel()) touched.insert(line.m_inst.GetLabel());
+		}
+		line.m_loc = loc;
+		loc += line.m_size;
+	}
+
+	// Translate the changed lines, and the operands of the symbols that changed.
+	set<string> moved, redefined;
+	UpdateSymbols(touched, moved, redefined);
+	for (size_t i = prefix; i < newEnd; ++i) {
+		Check(m_lines[i]);
+		Translate(m_lines[i]);
+	}
+	if (!moved.empty() || !redefined.empty()) {
+		for (size_t i = 0; i < m_lines.size(); ++i) {
+			SourceLine &line = m_lines[i];
+			if ((i >= prefix && i < newEnd) || line.m_inst.GetOperand().empty() || line.m_inst.isNumericOperand()) continue;
+			if (!redefined.empty() && redefined.count(line.m_inst.GetOperand()) > 0) Check(line);
+			if (moved.count(line.m_inst.GetOperand()) > 0) {
+				Translate(line);
+				m_counts.m_resolved++;
+			}
+		}
+	}
+	Collect();
+	return m_errors.empty();
+}
+
+void IncrementalAssembler::Parse( const string &a_text, SourceLine &a_line )
+{
+	a_line.m_text = a_text;
+	a_line.m_checkErrors.clear();
+	a_line.m_inst.SetExtended(m_extended);
+	Errors::InitErrorReporting();
+	a_line.m_inst.ParseInstruction(a_text);
+	a_line.m_parseErrors = Errors::GetErrors();
+	Errors::InitErrorReporting();
+	a_line.m_size = IsStatement(a_line) ? a_line.m_inst.LocationNextInstruction(0) : 0;
+}
+
+bool IncrementalAssembler::IsStatement( SourceLine &a_line )
+{
+	Instruction::InstructionType type = a_line.m_inst.GetType();
+	return type == Instruction::ST_MachineLanguage || type == Instruction::ST_AssemblerInstr;
+}
+
+void IncrementalAssembler::Check( SourceLine &a_line )
+{
+	if (!IsStatement(a_line)) return;
+	Errors::InitErrorReporting();
+	Assembler::CheckStatement(a_line.m_inst, m_symtab, m_buffers, m_memorySize);
+	a_line.m_checkErrors = Errors::GetErrors();
+	Errors::InitErrorReporting();
+}
+
+void IncrementalAssembler::Translate( SourceLine &a_line )
+{
+	if (!IsStatement(a_line)) return;
+	string contents = a_line.m_inst.GenerateMachineCode(m_symtab, m_memorySize);
+	a_line.m_contents = contents.empty() ? 0 : stoi(contents);
+}
+
+// A label is defined by its first definition before END, as in Pass I.
+void IncrementalAssembler::UpdateSymbols( const set<string> &a_touched, set<string> &a_moved, set<string> &a_redefined )
+{
+	for (string label : a_touched) {
+		bool defined = false, buffer = false;
+		int loc = 0;
+		map<string, vector<size_t>>::const_iterator found = m_definitions.find(label);
+		if (found != m_definitions.end()) {
+			for (size_t index : found->second) {
+				if (index >= m_end) break;
+				if (!defined) loc = m_lines[index].m_loc;
+				defined = true;
+				if (m_lines[index].m_inst.GetOpCode() == "BUF") buffer = true;
+			}
+		}
+		int oldLoc = 0;
+		bool wasDefined = m_symtab.LookupSymbol(label, oldLoc);
+		bool wasBuffer = m_buffers.count(label) > 0;
+		if (defined != wasDefined || buffer != wasBuffer) a_redefined.insert(label);
+		if (defined != wasDefined || loc != oldLoc) a_moved.insert(label);
+
+		if (defined) m_symtab.MoveSymbol(label, loc);
+		else if (wasDefined) m_symtab.RemoveSymbol(label);
+		if (buffer) m_buffers.insert(label);
+		else m_buffers.erase(label);
+	}
+}
+
+// Each error is listed once, in the order of the lines.
+void IncrementalAssembler::Collect( )
+{
+	m_errors.clear();
+	m_image = ProgramImage();
+	m_image.SetMemorySize(m_memorySize);
+	for (size_t i = 0; i < m_end; ++i) {
+		SourceLine &line = m_lines[i];
+		m_errors.insert(m_errors.end(), line.m_parseErrors.begin(), line.m_parseErrors.end());
+		if (!IsStatement(line)) continue;
+		if (line.m_inst.isLabel() && m_definitions[line.m_inst.GetLabel()].front() != i) {
+			m_errors.push_back("[Adding Symbol] Error: Multiply defined label '" + line.m_inst.GetLabel() + "'.");
+		}
+		m_errors.insert(m_errors.end(), line.m_checkErrors.begin(), line.m_checkErrors.end());
+		if (line.m_loc >= m_memorySize) {
+			m_errors.push_back("[Error Dec] Insufficient memory for the translation at location " + to_string(line.m_loc));
+		}
+		m_image.AddWord(line.m_loc, line.m_contents);
+	}
+	if (m_end == m_lines.size()) m_errors.push_back("[Parts] Missing END statement.");
+	m_image.SetSymbols(m_symtab.GetSymbols());
+}
+
+namespace {
+	// Runs the image on the inputs, displaying the output as a run on --inputs does.
+	template <typename t_Emulator> void RunImage( t_Emulator &a_emul, const ProgramImage &a_image, const vector<int> &a_inputs )
+	{
+		if (!a_emul.LoadImage(a_image)) {
+			Errors::DisplayErrors();
+			return;
+		}
+		cout << "Start of emulation." << endl;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		RunStatus status = a_emul.StreamBatch(a_inputs, []( const int *a_values, size_t a_count ) {
+			WriteWords(cout, a_values, a_count);
+		});
+		long long micros = MicrosSince(start);
+		if (status == RS_Halted) {
+			cout << "End of emulation." << endl;
+		} else {
+			cout << a_emul.GetErrorMessage() << endl;
+		}
+		cout << "[Watch] Ran " << a_emul.GetStepCount() << " instructions in " << micros << " us." << endl;
+	}
+}
+
+/*
+NAME
+
+    WatchSource - assembles and runs the source file each time it changes.
+
+SYNOPSIS
+
+    int WatchSource( const Options &a_options );
+
+DESCRIPTION
+
+    The file is looked at every kPollInterval.  When its modification time changes it is
+    read, the translation is brought up to date, and the program is run again on the
+    inputs given by --inputs if it has no errors.  The watch ends when the file can no
+    longer be read.
+*/
+int WatchSource( const Options &a_options )
+{
+	const string &path = a_options.GetSourceFile();
+	IncrementalAssembler assem(a_options.GetMemorySize(), a_options.IsExtended());
+	emulator emul;
+	PagedEmulator pagedEmul(a_options.GetMemorySize());
+	emul.SetLimits(a_options.GetLimits());
+	emul.EnableFastForward(a_options.IsFastForwarding());
+	emul.EnableExtended(a_options.IsExtended());
+	pagedEmul.SetLimits(a_options.GetLimits());
+	pagedEmul.EnableExtended(a_options.IsExtended());
+
+	filesystem::file_time_type lastWrite;
+	bool first = true;
+	while (true) {
+		error_code error;
+		filesystem::file_time_type writeTime = filesystem::last_write_time(path, error);
+		if (!error && !first && writeTime == lastWrite) {
+			this_thread::sleep_for(kPollInterval);
+			continue;
+		}
+		ifstream in(path);
+		ostringstream source;
+		if (error || !(source << in.rdbuf())) {
+			cout << "[Watch] " << path << " can no longer be read; watch ended." << endl;
+			return 0;
+		}
+		lastWrite = writeTime;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool assembled = assem.Update(source.str());
+		long long micros = MicrosSince(start);
+		const IncrementalAssembler::UpdateCounts &counts = assem.GetCounts();
+		if (first) {
+			cout << "[Watch] Assembled " << counts.m_lines << " lines of " << path << " in " << micros << " us." << endl;
+		} else if (counts.m_parsed == 0 && counts.m_removed == 0) {
+			continue;
+		} else {
+			cout << "[Watch] Reassembled " << path << " in " << micros << " us: " << counts.m_parsed << " of "
+				 << counts.m_lines << " lines parsed, " << counts.m_removed << " replaced or removed, " << counts.m_relocated
+				 << " relocated, " << counts.m_resolved << " operands resolved again." << endl;
+		}
+		first = false;
+
+		if (!assembled) {
+			Errors::InitErrorReporting();
+			for (const string &message : assem.GetErrors()) Errors::RecordError(message);
+			Errors::DisplayErrors();
+		} else if (a_options.GetMemorySize() != VC370Constants::kMaxMemory) {
+			RunImage(pagedEmul, assem.GetImage(), a_options.GetInputs());
+		} else {
+			RunImage(emul, assem.GetImage(), a_options.GetInputs());
+		}
+		cout << "[Watch] Waiting for changes to " << path << "." << endl;
+	}
+}
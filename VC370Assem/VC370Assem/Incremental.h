@@ -0,0 +1,90 @@
+//
+//		IncrementalAssembler class - keeps a translation up to date with a source that is
+//		being edited, for --watch.  Each line of the source keeps its parse, its location,
+//		the word it translates to and its errors.  An edit is found by comparing the lines
+//		with those of the last version, and only the lines that changed are parsed again.
+//		The locations are computed again from the first changed line until they line up
+//		with the old ones, and only the operands whose symbols moved are resolved again.
+//		The errors are those that the passes of the Assembler would report.
+//
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "SymTab.h"
+#include "Instruction.h"
+#include "Options.h"
+#include "ProgramImage.h"
+
+class IncrementalAssembler {
+
+public:
+
+	IncrementalAssembler(int a_memorySize, bool a_extended) : m_memorySize(a_memorySize), m_extended(a_extended) {}
+
+	// What the last call of Update did.
+	struct UpdateCounts {
+		size_t m_lines = 0;		// Lines of the source.
+		size_t m_parsed = 0;	// Lines parsed again.
+		size_t m_removed = 0;	// Lines they replaced.
+		size_t m_relocated = 0;	// Unchanged lines whose location changed.
+		size_t m_resolved = 0;	// Unchanged lines whose operand was resolved again.
+	};
+
+	// Brings the translation up to date with a_source.  Returns false if the translation
+	// has errors, which GetErrors lists.
+	bool Update(const string &a_source);
+
+	const ProgramImage &GetImage() const { return m_image; }
+	const vector<string> &GetErrors() const { return m_errors; }
+	const UpdateCounts &GetCounts() const { return m_counts; }
+
+private:
+
+	// A line of the source.
+	struct SourceLine {
+		string m_text;
+		Instruction m_inst;			// Its parse.
+		int m_loc = 0;				// The location of the statement.
+		int m_size = 0;				// Words it takes up, or skips for ORG.
+		int m_contents = 0;			// The word it translates to, if a statement.
+		vector<string> m_parseErrors;	// Errors of its parse.
+		vector<string> m_checkErrors;	// Errors of Assembler::CheckStatement.
+	};
+
+	// Parses a line of the source into a_line.
+	void Parse(const string &a_text, SourceLine &a_line);
+
+	// Whether the line is a statement, which the passes translate, and which may define a
+	// label.
+	static bool IsStatement(SourceLine &a_line);
+
+	// Checks the line again, and translates it again.
+	void Check(SourceLine &a_line);
+	void Translate(SourceLine &a_line);
+
+	// Brings the symbol table up to date for the symbols in a_touched, whose definitions may
+	// have changed.  Adds the symbols whose location changed to a_moved, and those that were
+	// defined or undefined, or became or stopped being buffers, to a_redefined.
+	void UpdateSymbols(const set<string> &a_touched, set<string> &a_moved, set<string> &a_redefined);
+
+	// Lists the errors of the translation, and puts its words into the image.
+	void Collect();
+
+	int m_memorySize;				// Words of memory the translation is for.
+	bool m_extended;				// Recognize the extended instruction set.
+	vector<SourceLine> m_lines;		// The source, as of the last update.
+	size_t m_end = 0;				// Index of its END line, or its number of lines.
+	map<string, vector<size_t>> m_definitions;	// Indices of the lines that define each label.
+	SymbolTable m_symtab;			// Location of the first definition of each label before END.
+	set<string> m_buffers;			// Labels of the BUF directives before END.
+	ProgramImage m_image;			// The translation.
+	vector<string> m_errors;		// Its errors.
+	UpdateCounts m_counts;			// What the last update did.
+};
+
+// Assembles the source file and runs it on the inputs of a_options, and does so again each
+// time the file changes, until it is removed.  Returns the exit status of the program.
+int WatchSource(const Options &a_options);
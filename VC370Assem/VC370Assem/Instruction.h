@@ -10,6 +10,7 @@
 #include <string>
 #include <iostream>
 #include "Errors.h"
+#include "VC370Constants.h"
 using namespace std;
 
 // The elements of an instruction.
@@ -43,23 +44,44 @@ public:
 			{"BM", 10},
 			{"BZ", 11},
 			{"BP", 12},
-			{"HALT", 13}
+			{"HALT", 13},
+			{"LOADX", 14},
+			{"STOREX", 15},
+			{"ADDX", 16},
+			{"SETX", 17},
+			{"INCX", 18},
+			{"BXLT", 19},
+			{"BCOPY", 20},
+			{"BSUM", 21},
+			{"BREAD", 22},
+			{"BWRITE", 23},
+			{"SPAWN", 24},
+			{"FADD", 25},
+			{"CAS", 26},
+			{"JOIN", 27}
 		};
 		return opcodeMap;
 	}
 
+	// The opcodes of the extended instruction set and its BUF directive, only recognized
+	// with --extended so that existing programs may still use them as labels.
+	static bool IsExtendedOpcode(const string& opcode) {
+		return opcode == "BUF" || OpcodeToNumber(opcode) > VC370Constants::OP_HALT;
+	}
+
+	// BUF reserves space as DS does, and declares it a buffer of BREAD and BWRITE.
 	static const set<string>& AssemblerDirectives() {
-		static const set<string> directives = {"ORG", "DC", "DS"};
+		static const set<string> directives = {"ORG", "DC", "DS", "BUF"};
 		return directives;
 	}
 
 	static set<string> BuildReservedKeywords() {
 		set<string> reserved = {"END", "BRANCH"};
 		for (const auto& entry : MachineOpcodes()) {
-			reserved.insert(entry.first);
+			if (!IsExtendedOpcode(entry.first)) reserved.insert(entry.first);
 		}
 		for (const auto& directive : AssemblerDirectives()) {
-			reserved.insert(directive);
+			if (!IsExtendedOpcode(directive)) reserved.insert(directive);
 		}
 		return reserved;
 	}
@@ -81,8 +103,8 @@ public:
 		return opcode == "END" || IsMachineOpcode(opcode) || IsAssemblerDirective(opcode);
 	}
 
-	static bool IsReservedKeyword(const string& token) {
-		return ReservedKeywords().find(token) != ReservedKeywords().end();
+	static bool IsReservedKeyword(const string& token, bool a_extended = false) {
+		return ReservedKeywords().find(token) != ReservedKeywords().end() || (a_extended && IsExtendedOpcode(token));
 	}
 
 	static int OpcodeToNumber(const string &opcode) {
@@ -122,6 +144,9 @@ public:
 	   // Determine the instruction type.
 		if (m_OpCode == "END") {
 			m_type = ST_End;
+		} else if (IsExtendedOpcode(m_OpCode) && !m_extended) {
+			Errors::RecordError("[Instruction Type] Extended opcode " + m_OpCode + " needs --extended");
+			m_type = ST_Comment;
 		} else if (IsMachineOpcode(m_OpCode)) {
 			m_type = ST_MachineLanguage;
 			m_NumOpCode = OpcodeToNumber(m_OpCode);
@@ -171,7 +196,7 @@ public:
 
     // Compute the location of the next instruction.
     int LocationNextInstruction(int a_loc) {
-		if (m_OpCode == "DS" || m_OpCode == "ORG") {
+		if (m_OpCode == "DS" || m_OpCode == "BUF" || m_OpCode == "ORG") {
 			return a_loc + m_OperandNumValue;
 		}
 		return a_loc + 1;
@@ -212,26 +237,31 @@ public:
 		return m_type;
 	};
 
-	// To generate the machine code equivalent of the instruction
-	string GenerateMachineCode(SymbolTable symbolTable) {
+	// Recognize the opcodes of the extended instruction set.
+	void SetExtended(bool a_extended) {
+		m_extended = a_extended;
+	};
+
+	bool IsExtended() const {
+		return m_extended;
+	};
+
+	// To generate the machine code equivalent of the instruction: two digits of opcode
+	// and as many digits of address as a memory of a_memorySize words needs.
+	string GenerateMachineCode(SymbolTable &symbolTable, int a_memorySize = VC370Constants::kMaxMemory) {
+		size_t digits = VC370Constants::AddressDigits(a_memorySize);
 		switch (m_type) {
 			case ST_MachineLanguage: {
 				int opcode = m_NumOpCode;
 				int operandAddress = m_IsNumericOperand ? m_OperandNumValue : 0;
 				symbolTable.LookupSymbol(m_Operand, operandAddress);
-				string a = to_string(opcode * 10);
-				string b = to_string(operandAddress);
-				return string(3 - a.length(), '0') + a 
-					 + string(3 - b.length(), '0') + b;
+				return ZeroPad(to_string(opcode), 2) + ZeroPad(to_string(operandAddress), digits);
 			}
 			case ST_AssemblerInstr:
-				if (m_OpCode == "DS") return ""; // Reserve space.
+				if (m_OpCode == "DS" || m_OpCode == "BUF") return ""; // Reserve space.
 				if (m_OpCode == "ORG") return ""; // Set location.
 				if (m_OpCode == "DC") {
-					string a = "";
-					string b = to_string(m_OperandNumValue);
-					return  string(3 - a.length(), '0') + a 
-						  + string(3 - b.length(), '0') + b;
+					return ZeroPad(to_string(m_OperandNumValue), 2 + digits);
 				}
 				break;
 			case ST_Comment:
@@ -249,6 +279,11 @@ private:
 
 	void GetLabelOpcodeEtc( const string &a_buff);
 
+	// Pads a number with zeros on the left to a_width digits.
+	static string ZeroPad(const string &a_digits, size_t a_width) {
+		return a_digits.length() < a_width ? string(a_width - a_digits.length(), '0') + a_digits : a_digits;
+	}
+
 
     // The elemements of a instruction
     string m_Label;         // The label.
@@ -264,5 +299,7 @@ private:
 
     bool m_IsNumericOperand;// == true if the operand is numeric.
     int m_OperandNumValue;  // The value of the operand if it is numeric.
+
+    bool m_extended = false;    // The extended instruction set is in use.
 };
 
@@ -0,0 +1,170 @@
+//
+//  Implementation of the block layout class.
+//
+#include "stdafx.h"
+#include "Layout.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace VC370Constants;
+
+/*
+NAME
+
+    Arrange - lays a translation out from a profile.
+
+SYNOPSIS
+
+    bool Arrange( const ProgramImage &a_image, const ExecutionProfile &a_profile, ProgramImage &a_laidOut );
+
+DESCRIPTION
+
+    The blocks are joined into chains along the edges the profiled run took most
+    often, and FlowGraph::Emit places the chains one after another, rewriting the
+    branch targets and symbols.  An edge can only be made to fall through if it is
+    already a fall through or it is the edge of a B, which is then left out:
+    the VC370 has no inverse of BM, BZ and BP.  The written order is kept unless the
+    chains execute fewer branches.
+*/
+bool BlockLayout::Arrange( const ProgramImage &a_image, const ExecutionProfile &a_profile, ProgramImage &a_laidOut )
+{
+	if (a_profile.m_imageHash != a_image.Hash()) {
+		m_refusal = "the profile is of a different translation";
+		return false;
+	}
+	if (!m_graph.Build(a_image, m_refusal)) return false;
+
+	for (const FlowGraph::Node &node : m_graph.GetNodes()) {
+		if (node.m_kind != ProgramImage::SK_Instruction || !FlowGraph::IsBranch(node.m_opcode)) continue;
+		m_executedBefore += a_profile.CountAt(node.m_loc);
+		m_takenBefore += a_profile.TakenAt(node.m_loc);
+	}
+	CountEdges(a_profile);
+
+	vector<int> order = ChainBlocks();
+	vector<int> written(order.size());
+	iota(written.begin(), written.end(), 0);
+	long long executed, taken, writtenExecuted, writtenTaken;
+	CountBranches(order, executed, taken);
+	CountBranches(written, writtenExecuted, writtenTaken);
+	if (writtenExecuted < executed || (writtenExecuted == executed && writtenTaken <= taken)) {
+		order = written;
+		executed = writtenExecuted;
+		taken = writtenTaken;
+	}
+	m_executedAfter = executed;
+	m_takenAfter = taken;
+
+	ProgramImage laidOut;
+	if (!m_graph.Emit(order, laidOut, m_refusal)) return false;
+	a_laidOut = laidOut;
+	return true;
+}
+
+void BlockLayout::DisplayReport( ostream &a_out ) const
+{
+	a_out << "Profile layout (counts from the profiled run):" << endl;
+	a_out << "Branches executed" << "\t\t" << m_executedBefore << " -> " << m_executedAfter << endl;
+	a_out << "Branches taken" << "\t\t\t" << m_takenBefore << " -> " << m_takenAfter << endl;
+}
+
+void BlockLayout::CountEdges( const ExecutionProfile &a_profile )
+{
+	const vector<FlowGraph::Block> &blocks = m_graph.GetBlocks();
+	m_exits.assign(blocks.size(), 0);
+	m_nextCount.assign(blocks.size(), 0);
+	m_takenCount.assign(blocks.size(), 0);
+	for (size_t b = 0; b < blocks.size(); ++b) {
+		const FlowGraph::Node &last = m_graph.GetNodes()[blocks[b].m_nodes.back()];
+		long long exits = a_profile.CountAt(last.m_loc);
+		m_exits[b] = exits;
+		if (last.m_opcode == OP_B) {
+			m_takenCount[b] = exits;
+		} else if (FlowGraph::IsBranch(last.m_opcode)) {
+			m_takenCount[b] = min(a_profile.TakenAt(last.m_loc), exits);
+			m_nextCount[b] = exits - m_takenCount[b];
+		} else if (last.m_opcode != OP_HALT) {
+			m_nextCount[b] = exits;
+		}
+	}
+}
+
+// Greedy chaining: an edge joins two chains if it leaves the tail of one and enters the
+// head of the other.  Edges that were never taken still join chains, which keeps the
+// cold code in its written order.
+vector<int> BlockLayout::ChainBlocks( ) const
+{
+	const vector<FlowGraph::Block> &blocks = m_graph.GetBlocks();
+	const vector<FlowGraph::Node> &nodes = m_graph.GetNodes();
+	vector<Edge> edges;
+	for (size_t b = 0; b < blocks.size(); ++b) {
+		if (blocks[b].m_next >= 0) edges.push_back(Edge{ int(b), blocks[b].m_next, m_nextCount[b] });
+		if (nodes[blocks[b].m_nodes.back()].m_opcode == OP_B && blocks[b].m_taken >= 0) {
+			edges.push_back(Edge{ int(b), blocks[b].m_taken, m_takenCount[b] });
+		}
+	}
+	stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.m_count > b.m_count; });
+
+	vector<vector<int>> chains(blocks.size());
+	vector<int> chainOf(blocks.size());
+	for (size_t b = 0; b < blocks.size(); ++b) {
+		chains[b] = { int(b) };
+		chainOf[b] = int(b);
+	}
+	for (const Edge &edge : edges) {
+		int from = chainOf[edge.m_from], to = chainOf[edge.m_to];
+		if (from == to || chains[from].back() != edge.m_from || chains[to].front() != edge.m_to) continue;
+		for (int b : chains[to]) {
+			chains[from].push_back(b);
+			chainOf[b] = from;
+		}
+		chains[to].clear();
+	}
+
+	// The chain holding the entry goes first and the others follow, hottest first.
+	int entry = chainOf[nodes[m_graph.GetEntry()].m_block];
+	vector<int> heads;
+	vector<long long> heat(chains.size(), 0);
+	for (size_t c = 0; c < chains.size(); ++c) {
+		if (chains[c].empty()) continue;
+		heads.push_back(int(c));
+		for (int b : chains[c]) heat[c] = max(heat[c], m_exits[b]);
+	}
+	stable_sort(heads.begin(), heads.end(), [&](int a, int b) {
+		if ((a == entry) != (b == entry)) return a == entry;
+		return heat[a] > heat[b];
+	});
+	vector<int> order;
+	for (int c : heads) {
+		order.insert(order.end(), chains[c].begin(), chains[c].end());
+	}
+	return order;
+}
+
+void BlockLayout::CountBranches( const vector<int> &a_order, long long &a_executed, long long &a_taken ) const
+{
+	const vector<FlowGraph::Block> &blocks = m_graph.GetBlocks();
+	vector<int> following(blocks.size(), -1);
+	for (size_t i = 0; i + 1 < a_order.size(); ++i) {
+		following[a_order[i]] = a_order[i + 1];
+	}
+	a_executed = a_taken = 0;
+	for (size_t b = 0; b < blocks.size(); ++b) {
+		int opcode = m_graph.GetNodes()[blocks[b].m_nodes.back()].m_opcode;
+		bool takenFollows = blocks[b].m_taken == following[b];
+		if (opcode == OP_B) {
+			if (!takenFollows) {
+				a_executed += m_exits[b];
+				a_taken += m_exits[b];
+			}
+		} else if (FlowGraph::IsBranch(opcode)) {
+			a_executed += m_exits[b];
+			if (!takenFollows) a_taken += m_takenCount[b];
+		}
+		// A B is added where the block control falls through to is not placed next.
+		if (blocks[b].m_next >= 0 && blocks[b].m_next != following[b]) {
+			a_executed += m_nextCount[b];
+			a_taken += m_nextCount[b];
+		}
+	}
+}
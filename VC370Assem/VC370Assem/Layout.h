@@ -0,0 +1,56 @@
+//
+//		Block layout class - lays a translation out again from the profile of a previous
+//		run, so that hot paths fall through and as few branches as possible execute.
+//
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "FlowGraph.h"
+#include "Profile.h"
+#include "ProgramImage.h"
+
+class BlockLayout {
+
+public:
+
+	// Lays a_image out using a_profile.  Returns false, leaving a_laidOut alone, if the
+	// profile is of another image or the program may not be rearranged; GetRefusal then
+	// says why.
+	bool Arrange(const ProgramImage &a_image, const ExecutionProfile &a_profile, ProgramImage &a_laidOut);
+
+	const string &GetRefusal() const { return m_refusal; }
+
+	// Displays the branches the profiled run executed and would execute after the layout.
+	void DisplayReport(ostream &a_out) const;
+
+private:
+
+	// A transfer of control between blocks and how often the profiled run took it.
+	struct Edge {
+		int m_from;
+		int m_to;
+		long long m_count;
+	};
+
+	// Records the counts of the blocks' edges from the profile.
+	void CountEdges(const ExecutionProfile &a_profile);
+
+	// Joins blocks into chains along the most frequent edges, hottest chains first.
+	vector<int> ChainBlocks() const;
+
+	// Branches the profiled run would execute, and of those the ones that would transfer
+	// control, with the blocks in a_order.
+	void CountBranches(const vector<int> &a_order, long long &a_executed, long long &a_taken) const;
+
+	FlowGraph m_graph;
+	vector<long long> m_exits;		// Executions of the last instruction of each block.
+	vector<long long> m_nextCount;	// Times each block fell through.
+	vector<long long> m_takenCount;	// Times the branch ending each block transferred control.
+	string m_refusal;				// Why the program was not laid out.
+	long long m_executedBefore = 0;	// Branches the profiled run executed.
+	long long m_takenBefore = 0;	// Branches that transferred control in the profiled run.
+	long long m_executedAfter = 0;	// The same with the new layout.
+	long long m_takenAfter = 0;
+};
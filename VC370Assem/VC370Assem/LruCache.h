@@ -0,0 +1,59 @@
+//
+//		LRU cache class - keeps the most recently used values, such as assembled
+//		program images or the results of runs, by 64 bit key.  Safe to use from
+//		several threads.
+//
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+using namespace std;
+
+template <class T>
+class LruCache {
+
+public:
+
+	explicit LruCache(size_t a_capacity) : m_capacity(a_capacity) {}
+
+	// Returns the value stored under a_key, or null.  A hit makes the value most recently used.
+	shared_ptr<const T> Find(uint64_t a_key)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto it = m_index.find(a_key);
+		if (it == m_index.end()) return nullptr;
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		return it->second->second;
+	}
+
+	// Stores a value under a_key, evicting the least recently used value if the cache is full.
+	void Insert(uint64_t a_key, shared_ptr<const T> a_value)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto it = m_index.find(a_key);
+		if (it != m_index.end()) {
+			it->second->second = move(a_value);
+			m_entries.splice(m_entries.begin(), m_entries, it->second);
+			return;
+		}
+		if (m_entries.size() >= m_capacity) {
+			m_index.erase(m_entries.back().first);
+			m_entries.pop_back();
+		}
+		m_entries.emplace_front(a_key, move(a_value));
+		m_index[a_key] = m_entries.begin();
+	}
+
+private:
+
+	typedef list<pair<uint64_t, shared_ptr<const T>>> EntryList;
+
+	mutex m_mutex;									// Guards everything below.
+	size_t m_capacity;								// Maximum number of values.
+	EntryList m_entries;							// Most recently used first.
+	unordered_map<uint64_t, typename EntryList::iterator> m_index;	// Entries by key.
+};
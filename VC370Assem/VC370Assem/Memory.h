@@ -0,0 +1,313 @@
+//
+//		Memory policies of the emulator.  FlatMemory is the classic memory of
+//		kMaxMemory words in a plain array.  PagedMemory is a larger memory whose pages
+//		are only allocated when first stored to, so that a big address space costs only
+//		the pages a program touches.  SharedMemory is the memory of the harts of a
+//		multiprocessor, a flat array of any size that they all access atomically.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "ProgramImage.h"
+#include "VC370Constants.h"
+
+// The sum of a_count words, wrapping as the accumulator does.  Eight lanes are added
+// separately so that the compiler can keep them in a vector register.
+inline uint32_t SumWords(const int *a_words, size_t a_count)
+{
+	const size_t kLanes = 8;
+	uint32_t lanes[kLanes] = {};
+	size_t i = 0;
+	for (; i + kLanes <= a_count; i += kLanes) {
+		for (size_t lane = 0; lane < kLanes; ++lane) lanes[lane] += uint32_t(a_words[i + lane]);
+	}
+	uint32_t sum = 0;
+	for (; i < a_count; ++i) sum += uint32_t(a_words[i]);
+	for (uint32_t lane : lanes) sum += lane;
+	return sum;
+}
+
+// The classic memory.  Its size is a constant, so that decoding a word divides by a
+// constant and the emulator runs as it always has.
+class FlatMemory {
+
+public:
+
+	// The loop fast forward works on the words in place, so it needs a flat memory.
+	static const bool kFlat = true;
+
+	explicit FlatMemory(int = VC370Constants::kMaxMemory) { Clear(); }
+
+	static constexpr int Size() { return VC370Constants::kMaxMemory; }
+
+	int Load(int a_loc) const { return m_words[a_loc]; }
+	void Store(int a_loc, int a_value) { m_words[a_loc] = a_value; }
+	void Clear() { memset(m_words, 0, sizeof(m_words)); }
+	uint64_t Hash() const { return Fnv1aHash(m_words, sizeof(m_words)); }
+	int *Data() { return m_words; }
+
+	// The block instructions.  The ranges must be in memory, and may overlap.
+	int Sum(int a_first, int a_count) const { return int(SumWords(m_words + a_first, a_count)); }
+	void Copy(int a_to, int a_from, int a_count) { memmove(m_words + a_to, m_words + a_from, a_count * sizeof(int)); }
+
+	// The block I/O instructions: a_count words between a_first and a_words.
+	void Get(int a_first, int a_count, int *a_words) const { memcpy(a_words, m_words + a_first, a_count * sizeof(int)); }
+	void Put(int a_first, int a_count, const int *a_words) { memcpy(m_words + a_first, a_words, a_count * sizeof(int)); }
+
+	// The atomic instructions, which need nothing more with a single hart.  Both return the
+	// word at a_loc before the instruction.
+	int FetchAdd(int a_loc, int a_value)
+	{
+		int old = m_words[a_loc];
+		m_words[a_loc] += a_value;
+		return old;
+	}
+	int CompareSwap(int a_loc, int a_expected, int a_desired)
+	{
+		int old = m_words[a_loc];
+		if (old == a_expected) m_words[a_loc] = a_desired;
+		return old;
+	}
+
+private:
+
+	int m_words[VC370Constants::kMaxMemory];
+};
+
+// An array of a_size elements that are zero until stored to, allocated a page at a time.
+template <typename T> class PagedArray {
+
+public:
+
+	static const int kPageBits = 12;
+	static const int kPageSize = 1 << kPageBits;
+
+	explicit PagedArray(int a_size) : m_size(a_size), m_pages((size_t(a_size) + kPageSize - 1) / kPageSize) {}
+
+	int Size() const { return m_size; }
+
+	// Locations outside the array read as zero, so that running off its end finds an
+	// illegal opcode rather than another page.
+	T Load(int a_loc) const
+	{
+		size_t page = unsigned(a_loc) >> kPageBits;
+		if (page >= m_pages.size() || !m_pages[page]) return T();
+		return m_pages[page][a_loc & (kPageSize - 1)];
+	}
+
+	// The element at a_loc, which must be in the array, allocating its page if need be.
+	T &At(int a_loc) { return GetPage(a_loc)[a_loc & (kPageSize - 1)]; }
+
+	// The page holding a_loc, or null if it was never stored to.
+	const T *FindPage(int a_loc) const { return m_pages[unsigned(a_loc) >> kPageBits].get(); }
+
+	// The page holding a_loc, allocating it if need be.
+	T *GetPage(int a_loc)
+	{
+		unique_ptr<T[]> &page = m_pages[unsigned(a_loc) >> kPageBits];
+		if (!page) {
+			page.reset(new T[kPageSize]());
+			m_pageCount++;
+		}
+		return page.get();
+	}
+
+	void Store(int a_loc, T a_value) { At(a_loc) = a_value; }
+
+	// Frees every page.
+	void Clear()
+	{
+		for (unique_ptr<T[]> &page : m_pages) page.reset();
+		m_pageCount = 0;
+	}
+
+	// The pages allocated so far.
+	size_t GetPageCount() const { return m_pageCount; }
+
+	// Calls a_visit(loc, value) for the elements of the allocated pages, in order.
+	template <typename t_Visit> void ForEach(t_Visit a_visit) const
+	{
+		for (size_t page = 0; page < m_pages.size(); ++page) {
+			if (!m_pages[page]) continue;
+			int first = int(page << kPageBits);
+			int end = int(min<size_t>(m_size, first + size_t(kPageSize)));
+			for (int loc = first; loc < end; ++loc) a_visit(loc, m_pages[page][loc - first]);
+		}
+	}
+
+	// Hash of the contents.  Pages that hold only zeros are left out, so that the hash
+	// does not depend on which pages were touched.
+	uint64_t Hash() const
+	{
+		uint64_t hash = Fnv1aHash(&m_size, sizeof(m_size));
+		for (size_t page = 0; page < m_pages.size(); ++page) {
+			const T *words = m_pages[page].get();
+			if (words == nullptr || all_of(words, words + kPageSize, [](const T &a_word) { return a_word == T(); })) continue;
+			hash = Fnv1aHash(&page, sizeof(page), hash);
+			hash = Fnv1aHash(words, kPageSize * sizeof(T), hash);
+		}
+		return hash;
+	}
+
+private:
+
+	int m_size;							// Elements in the array.
+	vector<unique_ptr<T[]>> m_pages;	// The pages, null until first stored to.
+	size_t m_pageCount = 0;				// Pages allocated.
+};
+
+// A memory of any power of ten words up to kMaxWideMemory.
+class PagedMemory : public PagedArray<int> {
+
+public:
+
+	static const bool kFlat = false;
+
+	explicit PagedMemory(int a_size = VC370Constants::kMaxMemory) : PagedArray<int>(a_size) {}
+
+	// The block instructions, a run within a page at a time.  Pages never stored to add
+	// nothing, and are only allocated by a copy if they receive a page that was.
+	int Sum(int a_first, int a_count) const
+	{
+		uint32_t sum = 0;
+		for (int loc = a_first, end = a_first + a_count; loc < end; ) {
+			int offset = loc & (kPageSize - 1);
+			int length = min(end - loc, kPageSize - offset);
+			const int *page = FindPage(loc);
+			if (page != nullptr) sum += SumWords(page + offset, length);
+			loc += length;
+		}
+		return int(sum);
+	}
+
+	void Get(int a_first, int a_count, int *a_words) const
+	{
+		for (int done = 0; done < a_count; ) {
+			int loc = a_first + done;
+			int length = min(a_count - done, kPageSize - (loc & (kPageSize - 1)));
+			const int *page = FindPage(loc);
+			if (page != nullptr) memcpy(a_words + done, page + (loc & (kPageSize - 1)), length * sizeof(int));
+			else fill_n(a_words + done, length, 0);
+			done += length;
+		}
+	}
+
+	void Put(int a_first, int a_count, const int *a_words)
+	{
+		for (int done = 0; done < a_count; ) {
+			int loc = a_first + done;
+			int length = min(a_count - done, kPageSize - (loc & (kPageSize - 1)));
+			memcpy(GetPage(loc) + (loc & (kPageSize - 1)), a_words + done, length * sizeof(int));
+			done += length;
+		}
+	}
+
+	int FetchAdd(int a_loc, int a_value)
+	{
+		int old = Load(a_loc);
+		Store(a_loc, old + a_value);
+		return old;
+	}
+	int CompareSwap(int a_loc, int a_expected, int a_desired)
+	{
+		int old = Load(a_loc);
+		if (old == a_expected) Store(a_loc, a_desired);
+		return old;
+	}
+
+	void Copy(int a_to, int a_from, int a_count)
+	{
+		// Copying from the end when the destination is above the source keeps an overlap
+		// from overwriting words before they are copied.
+		bool down = a_to > a_from;
+		for (int done = 0; done < a_count; ) {
+			int left = a_count - done, length;
+			int from, to;
+			if (down) {
+				length = min({ left, ((a_from + left - 1) & (kPageSize - 1)) + 1, ((a_to + left - 1) & (kPageSize - 1)) + 1 });
+				from = a_from + left - length;
+				to = a_to + left - length;
+			} else {
+				from = a_from + done;
+				to = a_to + done;
+				length = min({ left, kPageSize - (from & (kPageSize - 1)), kPageSize - (to & (kPageSize - 1)) });
+			}
+			const int *source = FindPage(from);
+			if (source != nullptr) {
+				memmove(GetPage(to) + (to & (kPageSize - 1)), source + (from & (kPageSize - 1)), length * sizeof(int));
+			} else if (FindPage(to) != nullptr) {
+				fill_n(GetPage(to) + (to & (kPageSize - 1)), length, 0);
+			}
+			done += length;
+		}
+	}
+};
+
+// The memory of a multiprocessor.  Copies share the words, so that each hart can have its
+// own emulator on the same memory.  Every word is accessed through atomic_ref, so harts
+// on different threads never race in the sense of the language: LOAD and STORE are relaxed,
+// and FADD and CAS are sequentially consistent.  Block instructions are atomic a word at a
+// time, not as a whole.
+class SharedMemory {
+
+public:
+
+	static const bool kFlat = false;
+
+	explicit SharedMemory(int a_size = VC370Constants::kMaxMemory) : m_size(a_size), m_words(new int[a_size]()) {}
+
+	int Size() const { return m_size; }
+
+	int Load(int a_loc) const { return Word(a_loc).load(memory_order_relaxed); }
+	void Store(int a_loc, int a_value) { Word(a_loc).store(a_value, memory_order_relaxed); }
+
+	// Only while no hart is running.
+	void Clear() { memset(m_words.get(), 0, m_size * sizeof(int)); }
+	uint64_t Hash() const { return Fnv1aHash(m_words.get(), m_size * sizeof(int)); }
+
+	int Sum(int a_first, int a_count) const
+	{
+		uint32_t sum = 0;
+		for (int loc = a_first; loc < a_first + a_count; ++loc) sum += uint32_t(Load(loc));
+		return int(sum);
+	}
+
+	void Copy(int a_to, int a_from, int a_count)
+	{
+		if (a_to > a_from) {
+			for (int i = a_count - 1; i >= 0; --i) Store(a_to + i, Load(a_from + i));
+		} else {
+			for (int i = 0; i < a_count; ++i) Store(a_to + i, Load(a_from + i));
+		}
+	}
+
+	void Get(int a_first, int a_count, int *a_words) const
+	{
+		for (int i = 0; i < a_count; ++i) a_words[i] = Load(a_first + i);
+	}
+
+	void Put(int a_first, int a_count, const int *a_words)
+	{
+		for (int i = 0; i < a_count; ++i) Store(a_first + i, a_words[i]);
+	}
+
+	int FetchAdd(int a_loc, int a_value) { return Word(a_loc).fetch_add(a_value); }
+	int CompareSwap(int a_loc, int a_expected, int a_desired)
+	{
+		Word(a_loc).compare_exchange_strong(a_expected, a_desired);
+		return a_expected;
+	}
+
+private:
+
+	atomic_ref<int> Word(int a_loc) const { return atomic_ref<int>(m_words[a_loc]); }
+
+	int m_size;						// Words of memory.
+	shared_ptr<int[]> m_words;		// The words, shared by the copies.
+};
@@ -0,0 +1,260 @@
+//
+//  Implementation of the multiprocessor.
+//
+#include "stdafx.h"
+#include "Multiprocessor.h"
+#include <iostream>
+
+Multiprocessor::Multiprocessor( int a_memorySize, int a_maxHarts, bool a_deterministic )
+	: m_memory(a_memorySize), m_maxHarts(a_maxHarts), m_deterministic(a_deterministic)
+{
+}
+
+bool Multiprocessor::LoadImage( const ProgramImage &a_image )
+{
+	m_memory.Clear();
+	m_start = a_image.GetStart();
+	for (const ProgramImage::Word &word : a_image.GetWords()) {
+		if (word.m_loc < 0 || word.m_loc >= m_memory.Size()) {
+			Errors::RecordError("Grumble gumble - should not happen");
+			return false;
+		}
+		m_memory.Store(word.m_loc, word.m_contents);
+	}
+	return true;
+}
+
+long long Multiprocessor::GetStepCount( ) const
+{
+	long long steps = 0;
+	for (const unique_ptr<Hart> &hart : m_harts) steps += hart->GetStepCount();
+	return steps;
+}
+
+vector<long long> Multiprocessor::GetOpcodeCounts( ) const
+{
+	vector<long long> counts;
+	for (const unique_ptr<Hart> &hart : m_harts) {
+		const vector<long long> &hartCounts = hart->GetOpcodeCounts();
+		counts.resize(max(counts.size(), hartCounts.size()), 0);
+		for (size_t opcode = 0; opcode < hartCounts.size(); ++opcode) counts[opcode] += hartCounts[opcode];
+	}
+	return counts;
+}
+
+// Runs the program with READ and WRITE on the terminal, as emulator::runProgram does
+// without the friendly prompts.
+bool Multiprocessor::runProgram( )
+{
+	cout << "Start of emulation." << endl;
+	m_inputs = nullptr;
+	if (Run() != RS_Halted) {
+		Errors::RecordError(m_errorMsg);
+		return false;
+	}
+	cout << "End of emulation." << endl;
+	return true;
+}
+
+RunStatus Multiprocessor::RunBatch( const vector<int> &a_inputs )
+{
+	m_inputs = &a_inputs;
+	m_nextInput = 0;
+	RunStatus status = Run();
+	m_inputs = nullptr;
+	return status;
+}
+
+/*
+NAME
+
+    Run - runs the program on the harts.
+
+SYNOPSIS
+
+    RunStatus Run( );
+
+DESCRIPTION
+
+    Hart 0 starts at the start of the program.  On threads, the calling thread only
+    starts the thread of hart 0 and waits for every hart to finish; the harts start
+    the threads of the harts they spawn.  The threads are joined once no hart is left
+    to spawn another.  The run halted if no hart stopped it.
+*/
+RunStatus Multiprocessor::Run( )
+{
+	m_harts.clear();
+	m_turns.clear();
+	m_running = 0;
+	m_joining = 0;
+	m_joins = 0;
+	m_stopped = false;
+	m_status = RS_Halted;
+	m_errorMsg.clear();
+
+	if (m_deterministic) {
+		AddHart(m_start, 0, 0);
+		RunInTurn();
+		return m_status;
+	}
+	{
+		lock_guard<mutex> lock(m_mutex);
+		AddHart(m_start, 0, 0);
+	}
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_changed.wait(lock, [this] { return m_running == 0; });
+	}
+	for (thread &hartThread : m_threads) hartThread.join();
+	m_threads.clear();
+	return m_status;
+}
+
+void Multiprocessor::AddHart( int a_loc, int a_accum, int a_index )
+{
+	m_harts.push_back(make_unique<Hart>(m_memory));
+	Hart *hart = m_harts.back().get();
+	hart->SetLimits(m_limits);
+	hart->SetSlice(m_deterministic ? kTurnSlice : kThreadSlice);
+	hart->EnableOpcodeCounts(m_counting);
+	hart->EnableSpawn(true);
+	hart->EnableExtended(m_extended);
+	hart->Spawned(a_loc, a_accum, a_index);
+	m_running++;
+	if (m_deterministic) {
+		m_turns.push_back(m_harts.size() - 1);
+	} else {
+		m_threads.emplace_back(&Multiprocessor::RunOnThread, this, hart);
+	}
+}
+
+// A JOIN waits on m_changed until the last hart it waits for arrives or finishes, which
+// counts the JOIN as released.
+void Multiprocessor::RunOnThread( Hart *a_hart )
+{
+	while (true) {
+		EmulatorEvent event = a_hart->Execute();
+		if (event == EV_Join) {
+			unique_lock<mutex> lock(m_mutex);
+			if (++m_joining == m_running) {
+				m_joining = 0;
+				m_joins++;
+				m_changed.notify_all();
+			} else {
+				long long joins = m_joins;
+				m_changed.wait(lock, [this, joins] { return m_joins != joins || m_stopped; });
+			}
+			if (m_stopped) break;
+		} else if (!Serve(*a_hart, event)) {
+			break;
+		}
+	}
+	lock_guard<mutex> lock(m_mutex);
+	m_running--;
+	if (m_joining > 0 && m_joining == m_running) {
+		m_joining = 0;
+		m_joins++;
+	}
+	m_changed.notify_all();
+}
+
+// The harts waiting in a JOIN are set aside until it is released, and then take their
+// turns again in the order they were spawned.
+void Multiprocessor::RunInTurn( )
+{
+	vector<size_t> joining;
+	while (!m_turns.empty() && !m_stopped) {
+		size_t number = m_turns.front();
+		m_turns.pop_front();
+		Hart &hart = *m_harts[number];
+		EmulatorEvent event = hart.Execute();
+		if (event == EV_Join) {
+			joining.push_back(number);
+		} else if (Serve(hart, event)) {
+			m_turns.push_back(number);
+		} else {
+			m_running--;
+		}
+		if (!joining.empty() && int(joining.size()) == m_running) {
+			sort(joining.begin(), joining.end());
+			m_turns.insert(m_turns.end(), joining.begin(), joining.end());
+			joining.clear();
+		}
+	}
+}
+
+bool Multiprocessor::Serve( Hart &a_hart, EmulatorEvent a_event )
+{
+	switch (a_event) {
+		case EV_Read:
+		case EV_ReadBlock:
+		case EV_Write:
+		case EV_WriteBlock:
+			Transfer(a_hart, a_event);
+			return true;
+
+		case EV_Spawn: {
+			unique_lock<mutex> lock(m_mutex, defer_lock);
+			if (!m_deterministic) lock.lock();
+			if (int(m_harts.size()) >= m_maxHarts) {
+				Stop(RS_Error, "[Emulation] Error: SPAWN at location " + to_string(a_hart.GetLocation() - 1)
+					+ " needs more than the " + to_string(m_maxHarts) + " harts of --harts");
+				return false;
+			}
+			AddHart(a_hart.GetSpawnLocation(), a_hart.GetAccumulator(), a_hart.GetIndex());
+			return true;
+		}
+		case EV_Yield:
+			return !m_stopped;
+
+		case EV_Halt:
+			return false;
+
+		default: {
+			unique_lock<mutex> lock(m_mutex, defer_lock);
+			if (!m_deterministic) lock.lock();
+			Stop(a_hart);
+			return false;
+		}
+	}
+}
+
+// Input past the end of the batch inputs, or of cin, leaves the words unchanged, as
+// emulator::RunBatch and emulator::runProgram do.
+void Multiprocessor::Transfer( Hart &a_hart, EmulatorEvent a_event )
+{
+	lock_guard<mutex> lock(m_ioMutex);
+	int count = a_hart.GetIoCount();
+	vector<int> words(count);
+	if (a_event == EV_Read || a_event == EV_ReadBlock) {
+		size_t read = 0;
+		if (m_inputs != nullptr) {
+			read = min(words.size(), m_inputs->size() - m_nextInput);
+			copy_n(m_inputs->begin() + m_nextInput, read, words.begin());
+			m_nextInput += read;
+		} else {
+			cout << "? ";
+			read = ReadWords(cin, words.data(), words.size());
+		}
+		a_hart.SupplyInputs(words.data(), int(read));
+	} else {
+		a_hart.GetIoBlock(words.data());
+		WriteWords(cout, words.data(), words.size());
+	}
+}
+
+void Multiprocessor::Stop( const Hart &a_hart )
+{
+	Stop(a_hart.GetStatus(), a_hart.GetErrorMessage());
+}
+
+// Only the first hart to stop is reported.  The others see m_stopped at their next yield
+// or when their JOIN is woken.
+void Multiprocessor::Stop( RunStatus a_status, const string &a_message )
+{
+	if (m_stopped) return;
+	m_status = a_status;
+	m_errorMsg = a_message;
+	m_stopped = true;
+	m_changed.notify_all();
+}
@@ -0,0 +1,127 @@
+//
+//		Multiprocessor class - runs a program on several harts that share one memory.
+//		Each hart is an emulator with its own location, accumulator and index register.
+//		A run starts with hart 0 at the start of the program, and SPAWN starts another
+//		at a label with a copy of the registers of the hart that spawned it.  The run
+//		ends when every hart has halted, or when one of them stops with an error or a
+//		watchdog limit, which then applies to each hart on its own.
+//
+//		Each hart normally runs on its own thread.  The memory model is then:
+//
+//			- A LOAD or STORE, and each word moved by a block instruction, is atomic:
+//			  a hart never sees half of a store.  It is relaxed, so harts may see the
+//			  stores of other harts late and in a different order.
+//			- FADD and CAS are atomic and sequentially consistent, and order the LOADs
+//			  and STOREs of their hart around them.  A lock taken with CAS must be
+//			  released with FADD or CAS rather than STORE.
+//			- Everything a hart did before SPAWN is seen by the hart it spawned.
+//			- JOIN waits until every other hart has halted or is waiting in a JOIN
+//			  too, and releases them all.  Everything done before it by any hart is
+//			  seen after it by all of them.
+//			- The I/O of different harts is interleaved in no particular order.
+//
+//		In the deterministic mode the harts take turns on one thread instead, in the
+//		order they were spawned, each running until the first back edge after a slice
+//		of instructions or until it needs I/O, another hart or a JOIN.  Every run of a
+//		program on the same inputs then interleaves the harts the same way.
+//
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Emulator.h"
+
+typedef BasicEmulator<SharedMemory> Hart;
+
+class Multiprocessor {
+
+public:
+
+	Multiprocessor(int a_memorySize, int a_maxHarts, bool a_deterministic);
+
+	bool LoadImage(const ProgramImage &a_image);
+	void SetLimits(const RunLimits &a_limits) { m_limits = a_limits; }
+
+	// Counts the executions of each opcode by the harts of subsequent runs, as
+	// emulator::EnableOpcodeCounts does.  GetOpcodeCounts sums them over the harts.
+	void EnableOpcodeCounts(bool a_enable) { m_counting = a_enable; }
+	vector<long long> GetOpcodeCounts() const;
+
+	// Lets the harts execute the extended instruction set, as emulator::EnableExtended.
+	void EnableExtended(bool a_enable) { m_extended = a_enable; }
+
+	// As emulator::runProgram and emulator::RunBatch, for all the harts.  RunBatch
+	// displays the values written as the harts write them.
+	bool runProgram();
+	RunStatus RunBatch(const vector<int> &a_inputs);
+
+	// The outcome of the last run, the instructions retired by all its harts, and the
+	// harts it used.
+	RunStatus GetStatus() const { return m_status; }
+	long long GetStepCount() const;
+	int GetHartCount() const { return int(m_harts.size()); }
+	const string &GetErrorMessage() const { return m_errorMsg; }
+
+private:
+
+	// Runs the program from hart 0, with the input of the harts taken from m_inputs if
+	// set, or else from the terminal.
+	RunStatus Run();
+
+	// Adds a hart starting at a_loc with the registers given.  m_mutex must be held
+	// if the harts are running on threads.
+	void AddHart(int a_loc, int a_accum, int a_index);
+
+	// The body of the thread of a hart.
+	void RunOnThread(Hart *a_hart);
+
+	// Runs the harts in turn on the calling thread.
+	void RunInTurn();
+
+	// Carries out what a hart returned for other than JOIN.  Returns false if the hart
+	// is finished.
+	bool Serve(Hart &a_hart, EmulatorEvent a_event);
+
+	// Carries out the I/O of a hart.
+	void Transfer(Hart &a_hart, EmulatorEvent a_event);
+
+	// Ends the run after a hart stopped without halting.  m_mutex must be held if the
+	// harts are running on threads.
+	void Stop(const Hart &a_hart);
+	void Stop(RunStatus a_status, const string &a_message);
+
+	// Instructions a hart runs between checks for the end of the run, and between turns
+	// in the deterministic mode.
+	static const long long kThreadSlice = 1 << 20;
+	static const long long kTurnSlice = 1000;
+
+	SharedMemory m_memory;		// The memory of all the harts.
+	int m_maxHarts;				// Harts a run may use.
+	bool m_deterministic;		// The harts take turns on one thread.
+	int m_start = 100;			// Location of the first instruction.
+	RunLimits m_limits;			// Watchdog limits of each hart.
+	bool m_counting = false;	// The harts count the executions of each opcode.
+	bool m_extended = false;	// The harts execute the extended instruction set.
+
+	mutex m_mutex;				// Guards the harts, their threads and the counts below.
+	condition_variable m_changed;	// A JOIN was released or a hart finished.
+	deque<unique_ptr<Hart>> m_harts;	// The harts of the run, by the order they were spawned.
+	vector<thread> m_threads;	// Their threads.
+	deque<size_t> m_turns;		// The harts waiting for a turn in the deterministic mode, by number.
+	int m_running = 0;			// Harts that have not finished.
+	int m_joining = 0;			// Harts waiting in a JOIN.
+	long long m_joins = 0;		// JOINs released, so that a waiting hart can tell.
+	atomic<bool> m_stopped{ false };	// A hart stopped without halting.
+
+	mutex m_ioMutex;			// Serializes the I/O of the harts.
+	const vector<int> *m_inputs = nullptr;	// Inputs of RunBatch, or null for the terminal.
+	size_t m_nextInput = 0;		// The next of them.
+
+	RunStatus m_status = RS_NotRun;	// Outcome of the last run.
+	string m_errorMsg;			// Why it stopped, if it did not halt.
+};
@@ -0,0 +1,310 @@
+//
+//  Implementation of the optimizer class.
+//
+#include "stdafx.h"
+#include "Optimizer.h"
+#include <climits>
+#include <cstdint>
+#include <numeric>
+#include <set>
+
+using namespace VC370Constants;
+
+namespace {
+	const int kMaxHops = 16;	// Branches followed when threading a branch.
+
+	// Words occupied by the statements of an image.
+	int SizeOf(const ProgramImage &a_image)
+	{
+		int size = 0;
+		for (const ProgramImage::Statement &statement : a_image.GetStatements()) {
+			size += statement.m_length;
+		}
+		return size;
+	}
+
+	// Does the arithmetic of an instruction on constants the way the emulator does.
+	// Returns false for a division that the emulator would stop on or that overflows.
+	bool Fold(int a_opcode, int &a_accum, int a_operand)
+	{
+		uint32_t accum = uint32_t(a_accum), operand = uint32_t(a_operand);
+		switch (a_opcode) {
+			case OP_ADD: a_accum = int(accum + operand); return true;
+			case OP_SUB: a_accum = int(accum - operand); return true;
+			case OP_MULT: a_accum = int(accum * operand); return true;
+			case OP_DIV:
+				if (a_operand == 0 || (a_accum == INT_MIN && a_operand == -1)) return false;
+				a_accum /= a_operand;
+				return true;
+			default:
+				return false;
+		}
+	}
+}
+
+/*
+NAME
+
+    Optimize - optimizes a translation.
+
+SYNOPSIS
+
+    bool Optimize( const ProgramImage &a_image, ProgramImage &a_optimized );
+
+DESCRIPTION
+
+    The transformations only ever take instructions away or send a branch somewhere
+    that behaves the same, and the program is laid out again in its original order
+    with the code ahead of the data.  Nothing is done to a program whose flow graph
+    cannot be built, which includes every program that changes its own code.
+*/
+bool Optimizer::Optimize( const ProgramImage &a_image, ProgramImage &a_optimized )
+{
+	if (!m_graph.Build(a_image, m_refusal)) return false;
+	m_oldSize = SizeOf(a_image);
+
+	RemoveUnreachable();
+	ThreadBranches();
+	RemoveUnreachable();
+	FoldConstants();
+	EliminateLoadsAndStores();
+	RemoveDeadStores();
+	RemoveBranchesToNext();
+
+	vector<int> order(m_graph.GetBlocks().size());
+	iota(order.begin(), order.end(), 0);
+	ProgramImage optimized;
+	if (!m_graph.Emit(order, optimized, m_refusal)) return false;
+	m_newSize = SizeOf(optimized);
+	a_optimized = optimized;
+	return true;
+}
+
+void Optimizer::DisplayReport( ostream &a_out ) const
+{
+	a_out << "Optimization: " << m_oldSize << " words reduced to " << m_newSize << "." << endl;
+	a_out << "Branches threaded" << "\t\t" << m_threaded << endl;
+	a_out << "Unreachable instructions" << "\t" << m_unreachable << endl;
+	a_out << "Constant operations folded" << "\t" << m_folded << endl;
+	a_out << "Loads and stores eliminated" << "\t" << m_loadsStores << endl;
+	a_out << "Branches to next removed" << "\t" << m_branches << endl;
+}
+
+// A branch to a B goes straight to the B's destination.  A conditional branch to a
+// conditional branch is decided by the first condition, since the accumulator does
+// not change in between: the conditions are exclusive.
+void Optimizer::ThreadBranches( )
+{
+	vector<FlowGraph::Node> &nodes = m_graph.GetNodes();
+	for (FlowGraph::Node &node : nodes) {
+		if (!node.m_reachable || !FlowGraph::IsBranch(node.m_opcode)) continue;
+		int target = node.m_target;
+		for (int hops = 0; hops < kMaxHops; ++hops) {
+			const FlowGraph::Node &next = nodes[target];
+			int to;
+			if (next.m_opcode == OP_B) {
+				to = next.m_target;
+			} else if (FlowGraph::IsBranch(next.m_opcode) && node.m_opcode != OP_B) {
+				to = next.m_opcode == node.m_opcode ? next.m_target : m_graph.NextInstruction(target);
+			} else {
+				break;
+			}
+			if (to < 0 || to == target) break;
+			target = to;
+		}
+		if (target != node.m_target) {
+			node.m_target = target;
+			m_threaded++;
+		}
+	}
+	m_graph.Analyze();
+}
+
+// There is no indirect branch, so an instruction that cannot be reached is dead.
+void Optimizer::RemoveUnreachable( )
+{
+	for (FlowGraph::Node &node : m_graph.GetNodes()) {
+		if (node.m_kind != ProgramImage::SK_Instruction || node.m_reachable || node.m_removed || node.m_loc < 0) continue;
+		node.m_removed = true;
+		m_unreachable++;
+	}
+	m_graph.Analyze();
+}
+
+// Within a block, a LOAD of a cell nothing ever changes followed by arithmetic on
+// such cells becomes a LOAD of the result, which is a new DC unless one exists.
+void Optimizer::FoldConstants( )
+{
+	vector<FlowGraph::Node> &nodes = m_graph.GetNodes();
+	vector<bool> written(nodes.size(), false);
+	for (const FlowGraph::Node &node : nodes) {
+		if (node.m_reachable && FlowGraph::WritesOperand(node.m_opcode) && node.m_target >= 0) written[node.m_target] = true;
+	}
+	auto ReadOnly = [&](const FlowGraph::Node &a_node, int &a_value) {
+		if (a_node.m_target < 0 || (size_t(a_node.m_target) < written.size() && written[a_node.m_target])) return false;
+		const FlowGraph::Node &cell = nodes[a_node.m_target];
+		if (cell.m_kind == ProgramImage::SK_Instruction) return false;
+		a_value = cell.m_kind == ProgramImage::SK_Constant ? cell.m_value : 0;
+		return true;
+	};
+
+	for (const FlowGraph::Block &block : m_graph.GetBlocks()) {
+		int load = -1, value = 0, length = 0;
+		auto Close = [&]() {
+			if (length > 1) {
+				int constant = -1;
+				for (size_t c = 0; c < nodes.size() && constant < 0; ++c) {
+					bool readOnly = c >= written.size() || !written[c];
+					if (nodes[c].m_kind == ProgramImage::SK_Constant && readOnly && nodes[c].m_value == value) constant = int(c);
+				}
+				if (constant < 0) constant = m_graph.AddConstant(value, "        DC   " + to_string(value));
+				nodes[load].m_target = constant;
+				nodes[load].m_offset = 0;
+				m_folded += length - 1;
+			}
+			load = -1;
+			length = 0;
+		};
+		for (int n : block.m_nodes) {
+			int operand = 0;
+			bool readOnly = ReadOnly(nodes[n], operand);
+			if (load >= 0 && readOnly && Fold(nodes[n].m_opcode, value, operand)) {
+				nodes[n].m_removed = true;
+				length++;
+				continue;
+			}
+			Close();
+			if (nodes[n].m_opcode == OP_LOAD && readOnly) {
+				load = n;
+				value = operand;
+				length = 1;
+			}
+		}
+		Close();
+	}
+	m_graph.Analyze();
+}
+
+/*
+NAME
+
+    EliminateLoadsAndStores - removes redundant and dead accesses within blocks.
+
+SYNOPSIS
+
+    void EliminateLoadsAndStores( );
+
+DESCRIPTION
+
+    Going forwards, the cells known to hold the value of the accumulator are
+    tracked: a LOAD or STORE of one of them does nothing, as in STORE TEMP followed
+    by LOAD TEMP.  Going backwards, a LOAD or arithmetic whose result is replaced
+    before it is used is dead, and so is a STORE whose cell is stored again before
+    it is read.  Nothing is needed after a HALT.  Nothing is assumed about the
+    other blocks, so control entering a block only at its start keeps this safe.
+*/
+void Optimizer::EliminateLoadsAndStores( )
+{
+	vector<FlowGraph::Node> &nodes = m_graph.GetNodes();
+	for (const FlowGraph::Block &block : m_graph.GetBlocks()) {
+		auto Remove = [&](int a_node) {
+			nodes[a_node].m_removed = true;
+			m_loadsStores++;
+		};
+
+		set<Cell> same;		// Cells holding the value of the accumulator.
+		for (int n : block.m_nodes) {
+			Cell cell = CellOf(nodes[n]);
+			switch (nodes[n].m_opcode) {
+				case OP_LOAD:
+					if (same.count(cell)) Remove(n);
+					else same = { cell };
+					break;
+				case OP_STORE:
+					if (same.count(cell)) Remove(n);
+					else same.insert(cell);
+					break;
+				case OP_READ:
+					same.erase(cell);
+					break;
+				case OP_WRITE:
+					break;
+				default:
+					same.clear();
+					break;
+			}
+		}
+
+		bool halts = nodes[block.m_nodes.back()].m_opcode == OP_HALT;
+		bool accumLive = !halts;
+		bool allLive = !halts;	// Whether cells are live, apart from the exceptions.
+		set<Cell> exceptions;
+		auto IsLive = [&](const Cell &a_cell) { return allLive != (exceptions.count(a_cell) > 0); };
+		auto SetLive = [&](const Cell &a_cell, bool a_live) {
+			if (a_live == allLive) exceptions.erase(a_cell);
+			else exceptions.insert(a_cell);
+		};
+		for (auto it = block.m_nodes.rbegin(); it != block.m_nodes.rend(); ++it) {
+			int n = *it;
+			if (nodes[n].m_removed) continue;
+			int opcode = nodes[n].m_opcode;
+			Cell cell = CellOf(nodes[n]);
+			if (opcode == OP_LOAD || opcode == OP_ADD || opcode == OP_SUB || opcode == OP_MULT) {
+				if (!accumLive) {
+					Remove(n);
+					continue;
+				}
+				if (opcode == OP_LOAD) accumLive = false;
+			} else if (opcode == OP_STORE) {
+				if (!IsLive(cell)) {
+					Remove(n);
+					continue;
+				}
+				SetLive(cell, false);
+				accumLive = true;
+			} else if (opcode == OP_DIV || FlowGraph::IsBranch(opcode)) {
+				accumLive = true;
+			}
+			if (FlowGraph::ReadsOperand(opcode) || opcode == OP_READ) SetLive(cell, true);
+		}
+	}
+	m_graph.Analyze();
+}
+
+// A STORE to a cell that no instruction reads cannot affect the outputs.
+void Optimizer::RemoveDeadStores( )
+{
+	vector<FlowGraph::Node> &nodes = m_graph.GetNodes();
+	set<Cell> read;
+	for (const FlowGraph::Node &node : nodes) {
+		if (node.m_reachable && !node.m_removed && FlowGraph::ReadsOperand(node.m_opcode)) read.insert(CellOf(node));
+	}
+	for (FlowGraph::Node &node : nodes) {
+		if (node.m_reachable && !node.m_removed && node.m_opcode == OP_STORE && !read.count(CellOf(node))) {
+			node.m_removed = true;
+			m_loadsStores++;
+		}
+	}
+	m_graph.Analyze();
+}
+
+// The code is laid out in its original order, so a branch to the next instruction
+// does nothing.  Removing one can make another branch go to the next instruction.
+void Optimizer::RemoveBranchesToNext( )
+{
+	vector<FlowGraph::Node> &nodes = m_graph.GetNodes();
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t n = 0; n < nodes.size(); ++n) {
+			FlowGraph::Node &node = nodes[n];
+			if (!node.m_reachable || node.m_removed || !FlowGraph::IsBranch(node.m_opcode)) continue;
+			if (node.m_target == m_graph.NextInstruction(int(n))) {
+				node.m_removed = true;
+				m_branches++;
+				changed = true;
+			}
+		}
+		if (changed) m_graph.Analyze();
+	}
+}
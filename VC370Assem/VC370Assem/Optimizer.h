@@ -0,0 +1,49 @@
+//
+//		Optimizer class - the assemble time optimizer selected by -O.  It works on the flow
+//		graph of a translation and produces an image with the same outputs for every input.
+//
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include "FlowGraph.h"
+#include "ProgramImage.h"
+
+class Optimizer {
+
+public:
+
+	// Optimizes a_image into a_optimized.  Returns false, leaving a_optimized alone, if the
+	// program may not be rearranged; GetRefusal then says why.
+	bool Optimize(const ProgramImage &a_image, ProgramImage &a_optimized);
+
+	const string &GetRefusal() const { return m_refusal; }
+
+	// Displays what each transformation did.
+	void DisplayReport(ostream &a_out) const;
+
+private:
+
+	// A memory cell named by an operand: the node and the word, or -1 and the address.
+	typedef pair<int, int> Cell;
+	static Cell CellOf(const FlowGraph::Node &a_node) { return Cell(a_node.m_target, a_node.m_offset); }
+
+	// The transformations, in the order they run.
+	void ThreadBranches();
+	void RemoveUnreachable();
+	void FoldConstants();
+	void EliminateLoadsAndStores();
+	void RemoveDeadStores();
+	void RemoveBranchesToNext();
+
+	FlowGraph m_graph;
+	string m_refusal;		// Why the program was not optimized.
+	int m_oldSize = 0;		// Words of code and data before and after.
+	int m_newSize = 0;
+	int m_threaded = 0;		// Branches sent straight to their final destination.
+	int m_unreachable = 0;	// Instructions that could never execute.
+	int m_folded = 0;		// Arithmetic on constants done at assembly time.
+	int m_loadsStores = 0;	// Redundant or dead loads, stores and arithmetic.
+	int m_branches = 0;		// Branches to the next instruction.
+};
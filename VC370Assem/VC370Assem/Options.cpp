@@ -0,0 +1,251 @@
+//
+//  Implementation of the command line options class.
+//
+#include "stdafx.h"
+#include "Options.h"
+#include "Engine.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace {
+    const long long kDefaultPartialEvalSteps = 10'000'000;     // Limit of --partial-eval.
+    const long long kDefaultVerifyInterval = 10'000;            // Instructions between comparisons.
+    const long long kMaxHarts = 256;                            // Limit of --harts.
+}
+
+/*
+NAME
+
+    Options - parses the command line.
+
+SYNOPSIS
+
+    Options( int argc, char *argv[] );
+
+DESCRIPTION
+
+    Options precede the source file name and have the form --name or --name=value:
+
+        -O                  optimize the translation before running it.
+        --partial-eval[=N]  run the program up to its first READ at assembly time,
+                            for at most N instructions.
+        --profile-out=FILE  write the execution profile of the run to FILE.
+        --profile-use=FILE  lay the translation out using the profile in FILE.
+        --stats[=FILE]      write the time and allocations of each phase, and the
+                            instructions and estimated VC370 cycles of the run, as JSON
+                            to FILE or to the standard output.
+        --cycle-model=FILE  with --stats, estimate the cycles with the model in FILE.
+        --max-steps=N       stop the emulation after N instructions.
+        --max-time=MS       stop the emulation after MS milliseconds.
+        --no-fast-forward   execute every iteration of counted loops.
+        --extended          recognize the extended instruction set: the index register,
+                            the block instructions and the multiprocessor instructions.
+        --harts=N           run on a multiprocessor of up to N harts, one thread each.
+        --deterministic     with --harts, let the harts take turns on one thread, so
+                            that every run interleaves them the same way.
+        --memory=N          assemble and run for a memory of N words, a power of ten from
+                            10000 to 10000000.  Only plain runs support a wider memory.
+        --debug             run the program under the debugger.
+        --verify-engines[=ENGINE]   run ENGINE, or every engine, side by side with the
+                            reference engine instead of running the program normally.
+        --verify-interval=N compare the engines about every N instructions.
+        --stress=N          with --verify-engines, verify on N random programs instead of
+                            the source file.
+        --seed=N            seed of the random programs.
+        --async             run the emulation as a coroutine session.
+        --inputs=A,B,...    values for READ instead of the terminal.
+        --watch             with --inputs, assemble and run the program again each time
+                            the source file changes, parsing only the lines that changed.
+        --serve=SOCKET      run as a server listening on the Unix socket SOCKET.
+        --workers=N         worker threads of the server.
+        --cache-size=N      assembled images the server keeps.
+        --client=SOCKET     submit the source file to the server at SOCKET.
+        --quit              with --client, ask the server to quit.
+        --run-cache[=DIR]   memoize runs with known inputs, in memory and in DIR.
+        --run-cache-size=N  runs memoized in memory.
+*/
+Options::Options( int argc, char *argv[] )
+    : m_optimize( false ), m_partialEvalSteps( 0 ), m_stats( false ), m_debug( false ), m_verifyInterval( kDefaultVerifyInterval ), m_stressPrograms( 0 ), m_stressSeed( 1 ), m_fastForward( true ), m_extended( false ), m_harts( 0 ), m_deterministic( false ), m_memorySize( VC370Constants::kMaxMemory ), m_async( false ), m_haveInputs( false ), m_watch( false ), m_server( false ), m_client( false ), m_quit( false ),
+      m_workers( 4 ), m_cacheSize( 64 ), m_runCache( false ), m_runCacheSize( 1024 )
+{
+    for( int i = 1; i < argc; ++i ) {
+        string arg = argv[i];
+        if( arg == "-O" ) {
+            m_optimize = true;
+            continue;
+        }
+        if( arg.compare( 0, 2, "--" ) != 0 ) {
+            if( !m_sourceFile.empty() ) Usage( );
+            m_sourceFile = arg;
+            continue;
+        }
+        size_t eq = arg.find( '=' );
+        string name = arg.substr( 0, eq );
+        string value = eq == string::npos ? "" : arg.substr( eq + 1 );
+
+        if( name == "--partial-eval" ) {
+            m_partialEvalSteps = value.empty() ? kDefaultPartialEvalSteps : max( 1LL, ParseCount( arg, value ) );
+        } else if( name == "--profile-out" && !value.empty() ) {
+            m_profileOut = value;
+        } else if( name == "--profile-use" && !value.empty() ) {
+            m_profileUse = value;
+        } else if( name == "--stats" ) {
+            m_stats = true;
+            m_statsOut = value;
+        } else if( name == "--cycle-model" && !value.empty() ) {
+            m_cycleModel = value;
+        } else if( arg == "--debug" ) {
+            m_debug = true;
+        } else if( name == "--verify-engines" ) {
+            m_verifyEngines = value.empty() ? GetEngineNames() : vector<string>{ value };
+            if( !MakeEngine( value.empty() ? "reference" : value ) ) {
+                cerr << "Unknown engine: " << value << endl;
+                Usage( );
+            }
+        } else if( name == "--verify-interval" ) {
+            m_verifyInterval = max( 1LL, ParseCount( arg, value ) );
+        } else if( name == "--stress" ) {
+            m_stressPrograms = int( min( ParseCount( arg, value ), 1'000'000'000LL ) );
+        } else if( name == "--seed" ) {
+            m_stressSeed = unsigned( ParseCount( arg, value ) );
+        } else if( name == "--max-steps" ) {
+            m_limits.maxSteps = ParseCount( arg, value );
+        } else if( name == "--max-time" ) {
+            m_limits.maxMillis = ParseCount( arg, value );
+        } else if( arg == "--no-fast-forward" ) {
+            m_fastForward = false;
+        } else if( arg == "--extended" ) {
+            m_extended = true;
+        } else if( name == "--harts" ) {
+            m_harts = int( min( max( 1LL, ParseCount( arg, value ) ), kMaxHarts ) );
+        } else if( arg == "--deterministic" ) {
+            m_deterministic = true;
+        } else if( name == "--memory" ) {
+            long long size = ParseCount( arg, value );
+            long long power = VC370Constants::kMaxMemory;
+            while( power < size && power < VC370Constants::kMaxWideMemory ) power *= 10;
+            if( power != size ) {
+                cerr << "Option requires a power of ten from " << VC370Constants::kMaxMemory << " to "
+                     << VC370Constants::kMaxWideMemory << ": " << arg << endl;
+                Usage( );
+            }
+            m_memorySize = int( size );
+        } else if( arg == "--async" ) {
+            m_async = true;
+        } else if( name == "--inputs" ) {
+            m_haveInputs = true;
+            m_inputs = ParseList( arg, value );
+        } else if( arg == "--watch" ) {
+            m_watch = true;
+        } else if( name == "--serve" && !value.empty() ) {
+            m_server = true;
+            m_socketPath = value;
+        } else if( name == "--workers" ) {
+            m_workers = int( max( 1LL, ParseCount( arg, value ) ) );
+        } else if( name == "--cache-size" ) {
+            m_cacheSize = int( max( 1LL, ParseCount( arg, value ) ) );
+        } else if( name == "--client" && !value.empty() ) {
+            m_client = true;
+            m_socketPath = value;
+        } else if( arg == "--quit" ) {
+            m_quit = true;
+        } else if( name == "--run-cache" ) {
+            m_runCache = true;
+            m_runCacheDir = value;
+        } else if( name == "--run-cache-size" ) {
+            m_runCacheSize = int( max( 1LL, ParseCount( arg, value ) ) );
+        } else {
+            cerr << "Unknown option: " << arg << endl;
+            Usage( );
+        }
+    }
+    // Only the server, a client asking it to quit and the stress mode do without a source file.
+    bool needSource = !m_server && !( m_client && m_quit ) && m_stressPrograms == 0;
+    if( needSource && m_sourceFile.empty() ) Usage( );
+    if( m_quit && !m_client ) Usage( );
+    if( m_stressPrograms > 0 && m_verifyEngines.empty() ) Usage( );
+    if( !m_cycleModel.empty() && !m_stats ) Usage( );
+
+    // The passes that rearrange a translation, the profile, the debugger, the engines and
+    // the server all work on the classic memory.
+    bool rearranged = m_optimize || m_partialEvalSteps > 0 || !m_profileOut.empty() || !m_profileUse.empty();
+    bool elsewhere = m_debug || !m_verifyEngines.empty() || m_server || m_client;
+    if( m_memorySize != VC370Constants::kMaxMemory && ( rearranged || elsewhere ) ) {
+        cerr << "--memory cannot be combined with -O, --partial-eval, --profile-out, --profile-use, "
+             << "--debug, --verify-engines, --serve or --client." << endl;
+        Usage( );
+    }
+
+    // The multiprocessor only runs the translation as it was assembled, and its harts
+    // interleave differently from run to run unless deterministic.
+    if( m_deterministic && m_harts == 0 ) Usage( );
+    if( m_harts > 0 && ( rearranged || elsewhere || m_async || m_runCache ) ) {
+        cerr << "--harts cannot be combined with -O, --partial-eval, --profile-out, --profile-use, "
+             << "--debug, --verify-engines, --serve, --client, --async or --run-cache." << endl;
+        Usage( );
+    }
+
+    // The statistics are of a normal run of the source file.
+    if( m_stats && ( elsewhere || m_stressPrograms > 0 ) ) {
+        cerr << "--stats cannot be combined with --debug, --verify-engines, --stress, --serve or --client." << endl;
+        Usage( );
+    }
+
+    // The watch mode runs the translation as it was assembled, on the inputs given.
+    if( m_watch && ( !m_haveInputs || rearranged || elsewhere || m_stats || m_harts > 0 || m_async || m_runCache ) ) {
+        cerr << "--watch needs --inputs, and cannot be combined with -O, --partial-eval, --profile-out, --profile-use, "
+             << "--stats, --harts, --debug, --verify-engines, --serve, --client, --async or --run-cache." << endl;
+        Usage( );
+    }
+}
+
+long long Options::ParseCount( const string &a_arg, const string &a_value )
+{
+    auto IsDigit = []( char a_ch ) { return isdigit( static_cast<unsigned char>( a_ch ) ) != 0; };
+    long long count = -1;
+    if( !a_value.empty() && a_value.size() <= 18 && all_of( a_value.begin(), a_value.end(), IsDigit ) ) {
+        try {
+            count = stoll( a_value );
+        } catch( const exception & ) {
+            count = -1;
+        }
+    }
+    if( count < 0 ) {
+        cerr << "Option requires a non-negative number: " << a_arg << endl;
+        Usage( );
+    }
+    return count;
+}
+
+vector<int> Options::ParseList( const string &a_arg, const string &a_value )
+{
+    vector<int> values;
+    istringstream ins( a_value );
+    string item;
+    while( getline( ins, item, ',' ) ) {
+        size_t used = 0;
+        try {
+            values.push_back( stoi( item, &used ) );
+        } catch( const exception & ) {
+            used = 0;
+        }
+        if( used == 0 || used != item.size() ) {
+            cerr << "Option requires a list of numbers: " << a_arg << endl;
+            Usage( );
+        }
+    }
+    return values;
+}
+
+void Options::Usage( )
+{
+    cerr << "Usage: Assem [options] <FileName>" << endl
+         << "       Assem --serve=SOCKET [-O] [--workers=N] [--cache-size=N] [--run-cache[=DIR]] [--max-steps=N] [--max-time=MS]" << endl
+         << "       Assem --client=SOCKET [--inputs=A,B,...] <FileName>" << endl
+         << "       Assem --client=SOCKET --quit" << endl
+         << "       Assem --verify-engines[=ENGINE] --stress=N [--seed=N] [--verify-interval=N]" << endl
+         << "Options: -O --partial-eval[=N] --profile-out=FILE --profile-use=FILE --stats[=FILE] --cycle-model=FILE --max-steps=N --max-time=MS --async --inputs=A,B,... --watch" << endl
+         << "         --no-fast-forward --extended --harts=N --deterministic --memory=N --debug --verify-engines[=ENGINE] --verify-interval=N --run-cache[=DIR] --run-cache-size=N" << endl;
+    exit( 1 );
+}
@@ -0,0 +1,142 @@
+//
+//		Command line options for the assembler and emulator.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Emulator.h"
+using namespace std;
+
+class Options {
+
+public:
+
+    // Parses the command line.  Terminates with a usage message if it is malformed.
+    Options( int argc, char *argv[] );
+
+    // The source file to assemble.
+    const string &GetSourceFile( ) const { return m_sourceFile; }
+
+    // Run the optimizer on the translation.
+    bool IsOptimizing( ) const { return m_optimize; }
+
+    // Run the part of the program before its first READ at assembly time, for at most
+    // this many instructions.  Zero if not wanted.
+    long long GetPartialEvalSteps( ) const { return m_partialEvalSteps; }
+
+    // Write the execution profile of the run to a file, or lay the translation out using
+    // the profile in a file.  Empty if not wanted.
+    const string &GetProfileOut( ) const { return m_profileOut; }
+    const string &GetProfileUse( ) const { return m_profileUse; }
+
+    // Write the statistics of the run as JSON to a file, or to cout if the file is empty,
+    // estimating its cycles with the model in a file, or the default model if empty.
+    bool WantsStats( ) const { return m_stats; }
+    const string &GetStatsOut( ) const { return m_statsOut; }
+    const string &GetCycleModel( ) const { return m_cycleModel; }
+
+    // Run the translation under the debugger instead of running it normally.
+    bool IsDebugging( ) const { return m_debug; }
+
+    // Compare these engines with the reference engine instead of running the program
+    // normally, about every GetVerifyInterval instructions.  Empty if not wanted.
+    const vector<string> &GetVerifyEngines( ) const { return m_verifyEngines; }
+    long long GetVerifyInterval( ) const { return m_verifyInterval; }
+
+    // Verify the engines on this many random programs, generated from the seed, rather
+    // than on the source file.  Zero if not wanted.
+    int GetStressPrograms( ) const { return m_stressPrograms; }
+    unsigned GetStressSeed( ) const { return m_stressSeed; }
+
+    // Watchdog limits for the emulator.  Zero means unlimited.
+    long long GetMaxSteps( ) const { return m_limits.maxSteps; }
+    long long GetMaxMillis( ) const { return m_limits.maxMillis; }
+    const RunLimits &GetLimits( ) const { return m_limits; }
+
+    // Let the emulator run counted loops many iterations at a time.
+    bool IsFastForwarding( ) const { return m_fastForward; }
+
+    // Assemble the extended instruction set: the index register, the block instructions
+    // and the multiprocessor instructions.
+    bool IsExtended( ) const { return m_extended; }
+
+    // Run the program on a multiprocessor of at most this many harts, each on its own
+    // thread, or taking turns on one thread if deterministic.  Zero if not wanted.
+    int GetHarts( ) const { return m_harts; }
+    bool IsDeterministic( ) const { return m_deterministic; }
+
+    // Words of memory to assemble and run the program for.  kMaxMemory unless --memory
+    // selected a wider, paged memory.
+    int GetMemorySize( ) const { return m_memorySize; }
+
+    // Run the emulation through the coroutine scheduler rather than runProgram.
+    bool IsAsync( ) const { return m_async; }
+
+    // Inputs for the READ instructions, given instead of reading the terminal.
+    bool HasInputs( ) const { return m_haveInputs; }
+    const vector<int> &GetInputs( ) const { return m_inputs; }
+
+    // Assemble and run the program again each time the source file changes.
+    bool IsWatching( ) const { return m_watch; }
+
+    // Server mode: listen on GetSocketPath with a pool of workers and an image cache.
+    bool IsServer( ) const { return m_server; }
+    int GetWorkers( ) const { return m_workers; }
+    int GetCacheSize( ) const { return m_cacheSize; }
+
+    // Client mode: submit the source file to the server at GetSocketPath, or ask it to quit.
+    bool IsClient( ) const { return m_client; }
+    bool IsQuit( ) const { return m_quit; }
+
+    const string &GetSocketPath( ) const { return m_socketPath; }
+
+    // Memoize runs with known inputs.  The directory is the on-disk tier, or empty.
+    bool UseRunCache( ) const { return m_runCache; }
+    const string &GetRunCacheDir( ) const { return m_runCacheDir; }
+    int GetRunCacheSize( ) const { return m_runCacheSize; }
+
+private:
+
+    // Parses the numeric value of an option of the form --name=value.
+    static long long ParseCount( const string &a_arg, const string &a_value );
+
+    // Parses a comma separated list of integers.
+    static vector<int> ParseList( const string &a_arg, const string &a_value );
+
+    // Displays the usage message and terminates.
+    static void Usage( );
+
+    string m_sourceFile;    // The source file named on the command line.
+    bool m_optimize;        // -O was given.
+    long long m_partialEvalSteps;   // Limit of the partial evaluation, or zero.
+    string m_profileOut;    // Where to write the execution profile.
+    string m_profileUse;    // The profile to lay the translation out with.
+    bool m_stats;           // --stats was given.
+    string m_statsOut;      // Where to write the statistics, or empty for cout.
+    string m_cycleModel;    // The cycle model to estimate with, or empty for the default.
+    bool m_debug;           // --debug was given.
+    vector<string> m_verifyEngines;     // Engines to compare with the reference engine.
+    long long m_verifyInterval;         // Instructions between comparisons.
+    int m_stressPrograms;   // Random programs to verify the engines on.
+    unsigned m_stressSeed;  // Seed of the random programs.
+    RunLimits m_limits;     // Watchdog limits for the emulation.
+    bool m_fastForward;     // --no-fast-forward was not given.
+    bool m_extended;        // --extended was given.
+    int m_harts;            // Harts of the multiprocessor, or zero.
+    bool m_deterministic;   // --deterministic was given.
+    int m_memorySize;       // Words of memory.
+    bool m_async;           // Use the coroutine front end.
+    bool m_haveInputs;      // --inputs was given.
+    vector<int> m_inputs;   // Values for the READ instructions.
+    bool m_watch;           // --watch was given.
+    bool m_server;          // Run as a server.
+    bool m_client;          // Run as a client of a server.
+    bool m_quit;            // Ask the server to quit.
+    string m_socketPath;    // Socket of the server.
+    int m_workers;          // Worker threads of the server.
+    int m_cacheSize;        // Images the server keeps assembled.
+    bool m_runCache;        // Memoize runs.
+    string m_runCacheDir;   // Directory of memoized runs.
+    int m_runCacheSize;     // Runs memoized in memory.
+};
@@ -0,0 +1,193 @@
+//
+//  Implementation of the partial evaluator class.
+//
+#include "stdafx.h"
+#include "PartialEvaluator.h"
+#include "Emulator.h"
+#include "FlowGraph.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+
+using namespace VC370Constants;
+
+namespace {
+	// A statement in the layout of the source files, for the listing.
+	string FormatStatement(const string &a_label, const string &a_opcode, int a_operand)
+	{
+		string text = a_label + string(max<size_t>(1, 8 - a_label.size()), ' ') + a_opcode;
+		return text + string(max<size_t>(1, 5 - a_opcode.size()), ' ') + to_string(a_operand);
+	}
+
+	// The label of a source statement, if it has one.
+	string LabelOf(const string &a_source)
+	{
+		if (a_source.empty() || a_source[0] == ' ' || a_source[0] == '\t') return "";
+		return a_source.substr(0, a_source.find_first_of(" \t;"));
+	}
+}
+
+/*
+NAME
+
+    Evaluate - runs the part of a program before its first READ.
+
+SYNOPSIS
+
+    bool Evaluate( const ProgramImage &a_image, ProgramImage &a_evaluated );
+
+DESCRIPTION
+
+    Until its first READ nothing a program does can depend on its input, so that part
+    is run here and the memory it leaves becomes the new image, which resumes at the
+    READ.  The values written on the way are written again by a prologue placed
+    above everything the program names, which also reloads the accumulator.  A
+    program that halts without reading becomes just the prologue and a HALT.  The
+    prologue is only out of the way if the program cannot change its own code, so
+    the programs that FlowGraph refuses are refused here too.
+*/
+bool PartialEvaluator::Evaluate( const ProgramImage &a_image, ProgramImage &a_evaluated )
+{
+	FlowGraph graph;
+	if (!graph.Build(a_image, m_refusal)) return false;
+
+	unique_ptr<emulator> emul(new emulator);
+	RunLimits limits;
+	limits.maxSteps = m_maxSteps;
+	emul->SetLimits(limits);
+	if (!emul->LoadImage(a_image)) {
+		m_refusal = "the image does not fit in memory";
+		return false;
+	}
+	emul->Reset();
+	bool reading = false;
+	while (!reading && !m_halted) {
+		switch (emul->Execute()) {
+			case EV_Write:
+				m_outputs.push_back(emul->GetIoValue());
+				break;
+			case EV_Read:
+				reading = true;
+				break;
+			case EV_Halt:
+				m_halted = true;
+				break;
+			case EV_Yield:
+				break;
+			case EV_Limit:
+				m_refusal = "no READ or HALT within " + to_string(m_maxSteps) + " instructions";
+				return false;
+			default:
+				m_refusal = "the program stops with an error before it reads: " + emul->GetErrorMessage();
+				return false;
+		}
+	}
+	// The READ is executed again when the new image resumes.
+	m_steps = emul->GetStepCount() - (reading ? 1 : 0);
+	m_resume = reading ? emul->GetLocation() - 1 : 0;
+	int accum = emul->GetAccumulator();
+
+	ProgramImage image;
+	int top = a_image.GetStatements().empty() ? a_image.GetStart() : a_image.GetStatements().front().m_loc;
+	if (reading) {
+		// Memory as the program left it, described by the original statements.  Storage
+		// that now holds values is split into constants and the runs of zeros between.
+		vector<bool> covered(kMaxMemory, false);
+		for (const ProgramImage::Statement &statement : a_image.GetStatements()) {
+			int end = statement.m_loc + statement.m_length;
+			top = max(top, end);
+			fill(covered.begin() + statement.m_loc, covered.begin() + end, true);
+			if (statement.m_kind != ProgramImage::SK_Storage) {
+				int contents = emul->GetMemory(statement.m_loc);
+				image.AddWord(statement.m_loc, contents);
+				image.AddStatement(statement.m_kind, statement.m_loc, 1, statement.m_source);
+				if (statement.m_kind == ProgramImage::SK_Instruction && contents / kMaxMemory != OP_HALT) {
+					top = max(top, contents % kMaxMemory + 1);
+				}
+				continue;
+			}
+			string label = LabelOf(statement.m_source);
+			bool whole = true;
+			for (int loc = statement.m_loc; loc < end; ++loc) whole = whole && emul->GetMemory(loc) == 0;
+			if (whole) {
+				image.AddWord(statement.m_loc, 0);
+				image.AddStatement(ProgramImage::SK_Storage, statement.m_loc, statement.m_length, statement.m_source);
+				continue;
+			}
+			int zeros = statement.m_loc;	// Start of the current run of zeros.
+			for (int loc = statement.m_loc; loc <= end; ++loc) {
+				if (loc < end && emul->GetMemory(loc) == 0) continue;
+				if (loc > zeros) {
+					image.AddWord(zeros, 0);
+					image.AddStatement(ProgramImage::SK_Storage, zeros, loc - zeros, FormatStatement(label, "DS", loc - zeros));
+					label.clear();
+				}
+				if (loc < end) {
+					image.AddWord(loc, emul->GetMemory(loc));
+					image.AddStatement(ProgramImage::SK_Constant, loc, 1, FormatStatement(label, "DC", emul->GetMemory(loc)));
+					label.clear();
+				}
+				zeros = loc + 1;
+			}
+		}
+		// Values stored outside the statements.
+		for (int loc = 0; loc < kMaxMemory; ++loc) {
+			if (covered[loc] || emul->GetMemory(loc) == 0) continue;
+			image.AddWord(loc, emul->GetMemory(loc));
+			image.AddStatement(ProgramImage::SK_Constant, loc, 1, FormatStatement("", "DC", emul->GetMemory(loc)));
+			top = max(top, loc + 1);
+		}
+		image.SetSymbols(a_image.GetSymbols());
+	}
+
+	m_start = top;
+	if (reading && m_outputs.empty() && accum == 0) {
+		m_start = m_resume;
+	} else {
+		// The prologue, followed by a constant for each value it needs.
+		bool reload = reading && accum != 0;
+		int loc = top + int(m_outputs.size()) + (reload ? 1 : 0) + 1;
+		map<int, int> cells;
+		vector<int> values = m_outputs, constants;
+		if (reload) values.push_back(accum);
+		for (int value : values) {
+			if (cells.count(value)) continue;
+			cells[value] = loc++;
+			constants.push_back(value);
+		}
+		if (loc > kMaxMemory) {
+			m_refusal = "no room for a prologue writing " + to_string(m_outputs.size()) + " values";
+			return false;
+		}
+		loc = top;
+		auto AddInstruction = [&](int a_opcode, const string &a_name, int a_address) {
+			image.AddWord(loc, a_opcode * kMaxMemory + a_address);
+			string source = a_opcode == OP_HALT ? "        HALT" : FormatStatement("", a_name, a_address);
+			image.AddStatement(ProgramImage::SK_Instruction, loc++, 1, source);
+		};
+		for (int value : m_outputs) AddInstruction(OP_WRITE, "WRITE", cells[value]);
+		if (reload) AddInstruction(OP_LOAD, "LOAD", cells[accum]);
+		if (reading) AddInstruction(OP_B, "B", m_resume);
+		else AddInstruction(OP_HALT, "HALT", 0);
+		for (int value : constants) {
+			image.AddWord(cells[value], value);
+			image.AddStatement(ProgramImage::SK_Constant, cells[value], 1, FormatStatement("", "DC", value));
+		}
+	}
+	image.SetStart(m_start);
+	a_evaluated = image;
+	return true;
+}
+
+void PartialEvaluator::DisplayReport( ostream &a_out ) const
+{
+	a_out << "Partial evaluation: " << m_steps << " instructions run at assembly time." << endl;
+	a_out << "Outputs precomputed" << "\t\t" << m_outputs.size() << endl;
+	if (m_halted) {
+		a_out << "The program does not read: it was reduced to its output." << endl;
+	} else {
+		a_out << "Execution resumes at the READ at location " << m_resume;
+		if (m_start != m_resume) a_out << ", after the prologue at location " << m_start;
+		a_out << "." << endl;
+	}
+}
@@ -0,0 +1,38 @@
+//
+//		Partial evaluator class - runs the part of a program that does not depend on its
+//		input at assembly time, producing an image that starts where that part ended.
+//
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ProgramImage.h"
+
+class PartialEvaluator {
+
+public:
+
+	// a_maxSteps bounds the instructions run at assembly time.
+	explicit PartialEvaluator(long long a_maxSteps) : m_maxSteps(a_maxSteps) {}
+
+	// Runs a_image up to its first READ and records the state reached in a_evaluated.
+	// Returns false, leaving a_evaluated alone, if that is not safe or the program does
+	// not get there within the step limit; GetRefusal then says why.
+	bool Evaluate(const ProgramImage &a_image, ProgramImage &a_evaluated);
+
+	const string &GetRefusal() const { return m_refusal; }
+
+	// Displays what was done at assembly time.
+	void DisplayReport(ostream &a_out) const;
+
+private:
+
+	long long m_maxSteps;		// Instructions that may be run at assembly time.
+	string m_refusal;			// Why the program was not evaluated.
+	long long m_steps = 0;		// Instructions run at assembly time.
+	vector<int> m_outputs;		// Values written before the first READ.
+	bool m_halted = false;		// The program halted without reading.
+	int m_resume = 0;			// Location of the first READ.
+	int m_start = 0;			// Where the new image starts.
+};
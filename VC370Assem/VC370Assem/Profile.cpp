@@ -0,0 +1,60 @@
+//
+//  Implementation of the execution profile.
+//
+#include "stdafx.h"
+#include "Profile.h"
+#include "VC370Constants.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+	const char *const kFileTag = "VC370PROFILE 1";	// First line of a profile.
+}
+
+// Only the locations that executed are listed, one per line with their counts.
+bool ExecutionProfile::Write(const string &a_path, string &a_error) const
+{
+	ofstream out(a_path);
+	out << kFileTag << endl << "image " << hex << setw(16) << setfill('0') << m_imageHash << dec << endl;
+	for (size_t loc = 0; loc < m_counts.size(); ++loc) {
+		if (m_counts[loc] == 0) continue;
+		out << loc << " " << m_counts[loc] << " " << TakenAt(int(loc)) << endl;
+	}
+	if (!out) {
+		a_error = "Cannot write the profile " + a_path;
+		return false;
+	}
+	return true;
+}
+
+bool ExecutionProfile::Read(const string &a_path, string &a_error)
+{
+	ifstream in(a_path);
+	string tag, word;
+	if (!in) {
+		a_error = "Cannot open the profile " + a_path;
+		return false;
+	}
+	if (!getline(in, tag) || tag != kFileTag || !(in >> word >> hex >> m_imageHash >> dec) || word != "image") {
+		a_error = a_path + " is not a profile";
+		return false;
+	}
+	m_counts.clear();
+	m_taken.clear();
+	long long loc, count, taken;
+	while (in >> loc >> count >> taken) {
+		if (loc < 0 || loc >= VC370Constants::kMaxMemory || count < 0 || taken < 0) break;
+		if (size_t(loc) >= m_counts.size()) {
+			m_counts.resize(size_t(loc) + 1, 0);
+			m_taken.resize(size_t(loc) + 1, 0);
+		}
+		m_counts[loc] = count;
+		m_taken[loc] = taken;
+	}
+	if (!in.eof()) {
+		a_error = "Malformed profile " + a_path;
+		return false;
+	}
+	return true;
+}
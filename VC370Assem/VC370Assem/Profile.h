@@ -0,0 +1,26 @@
+//
+//		Execution profile - how often each location of an image executed and how often
+//		control then went somewhere other than the next location.  Written by
+//		--profile-out and used by --profile-use to lay the program out again.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct ExecutionProfile {
+
+	uint64_t m_imageHash = 0;		// ProgramImage::Hash of the image that was run.
+	vector<long long> m_counts;		// Executions, indexed by location.
+	vector<long long> m_taken;		// Transfers of control away from the next location.
+
+	// Executions and transfers at a location, zero outside the profile.
+	long long CountAt(int a_loc) const { return a_loc >= 0 && size_t(a_loc) < m_counts.size() ? m_counts[a_loc] : 0; }
+	long long TakenAt(int a_loc) const { return a_loc >= 0 && size_t(a_loc) < m_taken.size() ? m_taken[a_loc] : 0; }
+
+	// Saves and loads the profile as text.  Return false with a message on failure.
+	bool Write(const string &a_path, string &a_error) const;
+	bool Read(const string &a_path, string &a_error);
+};
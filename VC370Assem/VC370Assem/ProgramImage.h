@@ -0,0 +1,102 @@
+//
+//		Program image class - the words the assembler produced and where execution starts,
+//		with the statements and symbols behind them for the passes that rearrange a program.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "VC370Constants.h"
+using namespace std;
+
+// 64 bit FNV-1a hash.  Pass the previous result as a_hash to hash several pieces.
+inline uint64_t Fnv1aHash(const void *a_data, size_t a_size, uint64_t a_hash = 14695981039346656037ULL)
+{
+	const unsigned char *bytes = static_cast<const unsigned char *>(a_data);
+	for (size_t i = 0; i < a_size; ++i) {
+		a_hash = (a_hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return a_hash;
+}
+
+class ProgramImage {
+
+public:
+
+	// A word of memory set by the program.  Every other word starts out as zero.
+	struct Word {
+		int m_loc;
+		int m_contents;
+	};
+
+	// What a source statement put in memory.
+	enum StatementKind {
+		SK_Instruction,		// A machine language instruction.
+		SK_Constant,		// A DC.
+		SK_Storage			// A DS: m_length words that start out as zero.
+	};
+
+	// A statement that occupies memory.
+	struct Statement {
+		StatementKind m_kind;
+		int m_loc;
+		int m_length;
+		string m_source;	// The original statement.
+	};
+
+	ProgramImage() : m_start(100), m_memorySize(VC370Constants::kMaxMemory) {}
+
+	// Records the contents of a memory location.
+	void AddWord(int a_loc, int a_contents) { m_words.push_back(Word{ a_loc, a_contents }); }
+
+	const vector<Word> &GetWords() const { return m_words; }
+
+	// Records a statement that occupies memory.  Statements are not part of the hash.
+	void AddStatement(StatementKind a_kind, int a_loc, int a_length, const string &a_source)
+	{
+		m_statements.push_back(Statement{ a_kind, a_loc, a_length, a_source });
+	}
+
+	const vector<Statement> &GetStatements() const { return m_statements; }
+
+	// The statement that put a location in memory, or null if none did.
+	const Statement *StatementAt(int a_loc) const
+	{
+		for (const Statement &statement : m_statements) {
+			if (a_loc >= statement.m_loc && a_loc < statement.m_loc + statement.m_length) return &statement;
+		}
+		return nullptr;
+	}
+
+	// The symbols of the program and their locations.  Not part of the hash.
+	void SetSymbols(const map<string, int> &a_symbols) { m_symbols = a_symbols; }
+	const map<string, int> &GetSymbols() const { return m_symbols; }
+
+	// The location at which execution starts.
+	int GetStart() const { return m_start; }
+	void SetStart(int a_start) { m_start = a_start; }
+
+	// The words of memory the image was assembled for, which sets how words are encoded.
+	int GetMemorySize() const { return m_memorySize; }
+	void SetMemorySize(int a_memorySize) { m_memorySize = a_memorySize; }
+
+	// Hash of the start location and the words, identifying the image.  The memory size
+	// is only hashed when it is not the classic one, so that older hashes stay valid.
+	uint64_t Hash() const
+	{
+		uint64_t hash = Fnv1aHash(&m_start, sizeof(m_start));
+		if (m_memorySize != VC370Constants::kMaxMemory) hash = Fnv1aHash(&m_memorySize, sizeof(m_memorySize), hash);
+		return Fnv1aHash(m_words.data(), m_words.size() * sizeof(Word), hash);
+	}
+
+private:
+
+	vector<Word> m_words;	// Words in the order they were recorded.
+	int m_start;			// Location of the first instruction to execute.
+	int m_memorySize;		// Words of memory the image was assembled for.
+	vector<Statement> m_statements;	// Statements in the order they were recorded.
+	map<string, int> m_symbols;		// Symbols and their locations.
+};
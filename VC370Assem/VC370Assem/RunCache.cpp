@@ -0,0 +1,118 @@
+//
+//  Implementation of the run cache class.
+//
+#include "stdafx.h"
+#include "RunCache.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace {
+	const char *const kFileTag = "VC370RUN 1";	// First line of a result file.
+}
+
+RunCache::RunCache(size_t a_capacity, const string &a_directory)
+	: m_memory(a_capacity), m_directory(a_directory)
+{
+}
+
+// The key covers the whole image, the start location, every input, the limits, as a
+// run that halted without limits may be stopped by a limit, and the instruction set, as
+// the extended opcodes are illegal in a classic run.
+uint64_t RunCache::Key(const ProgramImage &a_image, const vector<int> &a_inputs, const RunLimits &a_limits, bool a_extended)
+{
+	uint64_t hash = a_image.Hash();
+	unsigned char extended = a_extended ? 1 : 0;
+	hash = Fnv1aHash(&extended, sizeof(extended), hash);
+	hash = Fnv1aHash(&a_limits.maxSteps, sizeof(a_limits.maxSteps), hash);
+	hash = Fnv1aHash(&a_limits.maxMillis, sizeof(a_limits.maxMillis), hash);
+	size_t count = a_inputs.size();
+	hash = Fnv1aHash(&count, sizeof(count), hash);
+	return Fnv1aHash(a_inputs.data(), a_inputs.size() * sizeof(int), hash);
+}
+
+bool RunCache::Find(uint64_t a_key, RunResult &a_result)
+{
+	shared_ptr<const RunResult> found = m_memory.Find(a_key);
+	if (found) {
+		a_result = *found;
+		return true;
+	}
+	if (m_directory.empty() || !ReadFile(a_key, a_result)) return false;
+
+	// Promote the result to the memory tier.
+	m_memory.Insert(a_key, make_shared<RunResult>(a_result));
+	return true;
+}
+
+void RunCache::Insert(uint64_t a_key, const RunResult &a_result)
+{
+	m_memory.Insert(a_key, make_shared<RunResult>(a_result));
+	if (!m_directory.empty()) WriteFile(a_key, a_result);
+}
+
+string RunCache::PathOf(uint64_t a_key) const
+{
+	ostringstream path;
+	path << m_directory << "/" << hex << setw(16) << setfill('0') << a_key << ".run";
+	return path.str();
+}
+
+/*
+NAME
+
+    ReadFile - reads a result from the on-disk tier.
+
+SYNOPSIS
+
+    bool ReadFile( uint64_t a_key, RunResult &a_result ) const;
+
+DESCRIPTION
+
+    A result file holds, one per line: the tag, the status and the number of
+    instructions, the outputs preceded by their count, and the error message.
+    Files that do not have this form are treated as misses.
+*/
+bool RunCache::ReadFile(uint64_t a_key, RunResult &a_result) const
+{
+	ifstream file(PathOf(a_key));
+	string tag, message;
+	int status = 0;
+	size_t count = 0;
+	if (!getline(file, tag) || tag != kFileTag || !(file >> status >> a_result.m_steps >> count)) return false;
+	if (status < RS_Halted || status > RS_Error) return false;
+
+	a_result.m_status = RunStatus(status);
+	a_result.m_outputs.clear();
+	for (size_t i = 0; i < count; ++i) {
+		int value;
+		if (!(file >> value)) return false;
+		a_result.m_outputs.push_back(value);
+	}
+	file.ignore(numeric_limits<streamsize>::max(), '\n');
+	getline(file, a_result.m_message);
+	return bool(file) || file.eof();
+}
+
+// Writes to a temporary file and renames it so that readers never see a partial result.
+void RunCache::WriteFile(uint64_t a_key, const RunResult &a_result) const
+{
+	string path = PathOf(a_key);
+	ostringstream temp;
+	temp << path << ".tmp" << this_thread::get_id();
+	{
+		ofstream file(temp.str(), ios::out | ios::trunc);
+		file << kFileTag << "\n" << int(a_result.m_status) << " " << a_result.m_steps << "\n" << a_result.m_outputs.size();
+		for (int value : a_result.m_outputs) {
+			file << " " << value;
+		}
+		file << "\n" << a_result.m_message << "\n";
+		if (!file) {
+			remove(temp.str().c_str());
+			return;
+		}
+	}
+	rename(temp.str().c_str(), path.c_str());
+}
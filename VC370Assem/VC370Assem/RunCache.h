@@ -0,0 +1,53 @@
+//
+//		Run cache class - memoizes runs of the emulator.  A run is a pure function of
+//		the program image, the READ inputs, the limits and the instruction set, so its
+//		outputs and status can be replayed instead of emulated.  Results are kept in
+//		memory and, optionally, in a directory that outlives the process.  Safe to use
+//		from several threads.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Emulator.h"
+#include "LruCache.h"
+#include "ProgramImage.h"
+
+// The observable result of a run.
+struct RunResult {
+	RunStatus m_status = RS_NotRun;
+	long long m_steps = 0;		// Instructions retired.
+	vector<int> m_outputs;		// Values written, in order.
+	string m_message;			// The emulator's error message, if any.
+};
+
+class RunCache {
+
+public:
+
+	// a_directory is the on-disk tier; empty for memory only.
+	RunCache(size_t a_capacity, const string &a_directory);
+
+	// The key of a run of a_image on a_inputs under the watchdog limits a_limits, with the
+	// extended instruction set if a_extended.  Whatever else changes what a run does
+	// must be added to the key.
+	static uint64_t Key(const ProgramImage &a_image, const vector<int> &a_inputs, const RunLimits &a_limits, bool a_extended);
+
+	// Looks for a result in memory, then on disk.  Returns false on a miss.
+	bool Find(uint64_t a_key, RunResult &a_result);
+
+	// Records a result.  Only results of cacheable runs (emulator::IsCacheable) may be stored.
+	void Insert(uint64_t a_key, const RunResult &a_result);
+
+private:
+
+	// The file of a key in the on-disk tier.
+	string PathOf(uint64_t a_key) const;
+
+	bool ReadFile(uint64_t a_key, RunResult &a_result) const;
+	void WriteFile(uint64_t a_key, const RunResult &a_result) const;
+
+	LruCache<RunResult> m_memory;	// The in-memory tier.
+	string m_directory;				// The on-disk tier, or empty.
+};
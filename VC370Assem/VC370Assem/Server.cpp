@@ -0,0 +1,508 @@
+//
+//  Implementation of the server and its client.
+//
+#include "stdafx.h"
+#include "Server.h"
+#include "Assembler.h"
+#include "Optimizer.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	const size_t kMaxSourceBytes = 16 * 1024 * 1024;	// Largest source a request may carry.
+	const size_t kMaxInputs = 1024 * 1024;				// Most inputs a request may carry.
+	const size_t kMaxOutputs = 1024 * 1024;				// Most outputs a reply may carry.
+	const long long kDefaultMillis = 10'000;			// Time limit when none was given.
+	const chrono::seconds kRequestTimeout(30);			// Time a client has to send its request.
+
+	// Names of the run statuses in replies.
+	const char *StatusName(RunStatus a_status)
+	{
+		switch (a_status) {
+			case RS_Halted: return "halted";
+			case RS_StepLimit: return "step-limit";
+			case RS_TimeLimit: return "time-limit";
+			default: return "error";
+		}
+	}
+
+	string HashToString(uint64_t a_hash)
+	{
+		ostringstream outs;
+		outs << hex << setw(16) << setfill('0') << a_hash;
+		return outs.str();
+	}
+
+	// Formats a reply.  See Server.h.
+	string FormatReply(const string &a_status, const RunResult &a_result, bool a_imageCached, bool a_replayed,
+		bool a_cacheable, long long a_assembleMicros, long long a_runMicros)
+	{
+		ostringstream reply;
+		reply << "STATUS " << a_status << " " << a_result.m_steps << " " << a_imageCached << " " << a_replayed
+			  << " " << a_cacheable << " " << a_assembleMicros << " " << a_runMicros << "\n";
+		reply << "OUTPUT " << a_result.m_outputs.size();
+		for (int value : a_result.m_outputs) {
+			reply << " " << value;
+		}
+		reply << "\nMESSAGE " << a_result.m_message << "\n";
+		return reply.str();
+	}
+
+	// A reply for a request that was not run.
+	string FailureReply(const string &a_status, const string &a_message, long long a_assembleMicros = 0)
+	{
+		RunResult result;
+		result.m_message = a_message;
+		return FormatReply(a_status, result, false, false, false, a_assembleMicros, 0);
+	}
+
+	long long MicrosSince(chrono::steady_clock::time_point a_start)
+	{
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - a_start).count();
+	}
+
+#ifndef _WIN32
+	// Buffered reading and writing of a socket.
+	class Connection {
+
+	public:
+
+		explicit Connection(int a_fd) : m_fd(a_fd), m_pos(0) {}
+		~Connection() { close(m_fd); }
+
+		// Gives up on reading if all that is read has not arrived a_timeout from now, and
+		// on writing if the peer takes nothing for as long.  Without it both wait forever.
+		void SetTimeout(chrono::milliseconds a_timeout)
+		{
+			m_deadline = chrono::steady_clock::now() + a_timeout;
+			timeval send = ToTimeval(a_timeout);
+			setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &send, sizeof(send));
+		}
+
+		// Reads up to the next newline, which is not included.
+		bool ReadLine(string &a_line)
+		{
+			a_line.clear();
+			while (true) {
+				size_t nl = m_buffer.find('\n', m_pos);
+				if (nl != string::npos) {
+					a_line.append(m_buffer, m_pos, nl - m_pos);
+					m_pos = nl + 1;
+					return true;
+				}
+				a_line.append(m_buffer, m_pos, string::npos);
+				m_pos = m_buffer.size();
+				if (a_line.size() > kMaxSourceBytes || !Fill()) return false;
+			}
+		}
+
+		// Reads exactly a_count bytes.
+		bool ReadBytes(size_t a_count, string &a_bytes)
+		{
+			a_bytes.clear();
+			while (a_bytes.size() < a_count) {
+				if (m_pos == m_buffer.size() && !Fill()) return false;
+				size_t take = min(a_count - a_bytes.size(), m_buffer.size() - m_pos);
+				a_bytes.append(m_buffer, m_pos, take);
+				m_pos += take;
+			}
+			return true;
+		}
+
+		bool Write(const string &a_text)
+		{
+			size_t done = 0;
+			while (done < a_text.size()) {
+				ssize_t n = send(m_fd, a_text.data() + done, a_text.size() - done, 0);
+				if (n < 0 && errno == EINTR) continue;
+				if (n <= 0) return false;
+				done += size_t(n);
+			}
+			return true;
+		}
+
+	private:
+
+		// Replaces the consumed buffer with the next chunk from the socket.  With a deadline,
+		// each receive may only wait for what is left of it.
+		bool Fill()
+		{
+			char chunk[64 * 1024];
+			ssize_t n;
+			do {
+				if (m_deadline) {
+					auto left = chrono::duration_cast<chrono::milliseconds>(*m_deadline - chrono::steady_clock::now());
+					if (left.count() <= 0) return false;
+					timeval receive = ToTimeval(left);
+					setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &receive, sizeof(receive));
+				}
+				n = recv(m_fd, chunk, sizeof(chunk), 0);
+			} while (n < 0 && errno == EINTR);
+			if (n <= 0) return false;
+			m_buffer.assign(chunk, size_t(n));
+			m_pos = 0;
+			return true;
+		}
+
+		static timeval ToTimeval(chrono::milliseconds a_time)
+		{
+			timeval time;
+			time.tv_sec = time_t(a_time.count() / 1000);
+			time.tv_usec = suseconds_t(a_time.count() % 1000 * 1000);
+			return time;
+		}
+
+		int m_fd;			// The socket.
+		string m_buffer;	// Bytes received but not consumed.
+		size_t m_pos;		// Position of the first unconsumed byte.
+		optional<chrono::steady_clock::time_point> m_deadline;	// When reading gives up, if ever.
+	};
+
+	// Fills a Unix domain socket address.  Returns false if the path is too long.
+	bool MakeAddress(const string &a_path, sockaddr_un &a_addr)
+	{
+		memset(&a_addr, 0, sizeof(a_addr));
+		a_addr.sun_family = AF_UNIX;
+		if (a_path.size() >= sizeof(a_addr.sun_path)) return false;
+		memcpy(a_addr.sun_path, a_path.c_str(), a_path.size() + 1);
+		return true;
+	}
+
+	// Connects to the server.  Returns -1 on failure.
+	int ConnectTo(const string &a_path)
+	{
+		sockaddr_un addr;
+		if (!MakeAddress(a_path, addr)) return -1;
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) return -1;
+		if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+#endif
+}
+
+// Configures the server from the command line.
+Server::Server(const Options &a_options)
+	: m_socketPath(a_options.GetSocketPath()), m_workerCount(a_options.GetWorkers()),
+	  m_optimize(a_options.IsOptimizing()), m_fastForward(a_options.IsFastForwarding()), m_limits(a_options.GetLimits()), m_cache(size_t(a_options.GetCacheSize())),
+	  m_stopping(false), m_listenFd(-1)
+{
+	if (a_options.UseRunCache()) {
+		m_runCache.reset(new RunCache(size_t(a_options.GetRunCacheSize()), a_options.GetRunCacheDir()));
+	}
+	// A server must not let one program occupy a worker forever.
+	if (m_limits.maxSteps == 0 && m_limits.maxMillis == 0) {
+		m_limits.maxMillis = kDefaultMillis;
+	}
+}
+
+#ifdef _WIN32
+
+int Server::Run()
+{
+	cerr << "Server mode requires Unix domain sockets." << endl;
+	return 1;
+}
+void Server::Worker() {}
+void Server::HandleConnection(int) {}
+
+int RunClient(const Options &)
+{
+	cerr << "Client mode requires Unix domain sockets." << endl;
+	return 1;
+}
+
+#else
+
+/*
+NAME
+
+    Run - listens for requests and hands them to the worker pool.
+
+SYNOPSIS
+
+    int Run();
+
+DESCRIPTION
+
+    Binds the Unix domain socket, replacing a stale socket file, and accepts
+    connections until a worker receives a QUIT request.
+*/
+int Server::Run()
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un addr;
+	if (!MakeAddress(m_socketPath, addr)) {
+		cerr << "Socket path is too long: " << m_socketPath << endl;
+		return 1;
+	}
+	m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(m_socketPath.c_str());
+	if (m_listenFd < 0 || ::bind(m_listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+		|| listen(m_listenFd, 128) < 0) {
+		cerr << "Could not listen on " << m_socketPath << ": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	vector<thread> workers;
+	for (int i = 0; i < m_workerCount; ++i) {
+		workers.emplace_back(&Server::Worker, this);
+	}
+	cout << "Listening on " << m_socketPath << " with " << m_workerCount << " workers." << endl;
+
+	while (true) {
+		int fd = accept(m_listenFd, nullptr, nullptr);
+		if (fd < 0) {
+			lock_guard<mutex> lock(m_queueMutex);
+			if (m_stopping) break;
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			cerr << "Accept failed: " << strerror(errno) << endl;
+			m_stopping = true;
+			break;
+		}
+		lock_guard<mutex> lock(m_queueMutex);
+		m_queue.push_back(fd);
+		m_queueReady.notify_one();
+	}
+
+	m_queueReady.notify_all();
+	for (thread &worker : workers) {
+		worker.join();
+	}
+	close(m_listenFd);
+	unlink(m_socketPath.c_str());
+	cout << "Server stopped." << endl;
+	return 0;
+}
+
+// Serves queued connections until the server stops.
+void Server::Worker()
+{
+	while (true) {
+		int fd;
+		{
+			unique_lock<mutex> lock(m_queueMutex);
+			m_queueReady.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty()) return;
+			fd = m_queue.front();
+			m_queue.pop_front();
+		}
+		HandleConnection(fd);
+	}
+}
+
+/*
+NAME
+
+    HandleConnection - serves one request.
+
+SYNOPSIS
+
+    void HandleConnection( int a_fd );
+
+DESCRIPTION
+
+    Finds the image in the cache, assembling the source that came with the
+    request if it is not there, runs it on the inputs of the request and
+    replies with the outputs, the status and the timing.  A client that does
+    not send its whole request within kRequestTimeout, or stops taking the
+    reply for as long, is dropped so that it cannot hold on to the worker.
+*/
+void Server::HandleConnection(int a_fd)
+{
+	Connection conn(a_fd);
+	conn.SetTimeout(kRequestTimeout);
+	string header;
+	if (!conn.ReadLine(header)) return;
+
+	istringstream hins(header);
+	string command, hashText;
+	size_t inputCount = 0, sourceBytes = 0;
+	hins >> command;
+	if (command == "QUIT") {
+		{
+			lock_guard<mutex> lock(m_queueMutex);
+			m_stopping = true;
+		}
+		shutdown(m_listenFd, SHUT_RDWR);	// Wakes up accept.
+		conn.Write("BYE\n");
+		return;
+	}
+	hins >> hashText >> inputCount >> sourceBytes;
+	string inputLine, source;
+	if (command != "RUN" || !hins || inputCount > kMaxInputs || sourceBytes > kMaxSourceBytes
+		|| !conn.ReadLine(inputLine) || !conn.ReadBytes(sourceBytes, source)) {
+		conn.Write(FailureReply("bad-request", "Malformed request."));
+		return;
+	}
+	vector<int> inputs;
+	istringstream iins(inputLine);
+	for (int value; inputs.size() < inputCount && iins >> value; ) {
+		inputs.push_back(value);
+	}
+
+	// The image is keyed by the hash of the source, so a resubmitted source is a hit.
+	uint64_t key = sourceBytes > 0 ? Fnv1aHash(source.data(), source.size()) : strtoull(hashText.c_str(), nullptr, 16);
+	long long assembleMicros = 0;
+	shared_ptr<const ProgramImage> image = m_cache.Find(key);
+	bool cached = image != nullptr;
+	if (!image) {
+		if (sourceBytes == 0) {
+			conn.Write(FailureReply("unknown-image", "Image " + HashToString(key) + " is not cached."));
+			return;
+		}
+		auto start = chrono::steady_clock::now();
+		auto assembled = make_shared<ProgramImage>();
+		vector<string> errors;
+		bool ok;
+		{
+			lock_guard<mutex> lock(m_assembleMutex);
+			ok = Assembler::AssembleText(source, *assembled, errors);
+		}
+		assembleMicros = MicrosSince(start);
+		if (!ok) {
+			string message;
+			for (const string &error : errors) {
+				message += (message.empty() ? "" : "; ") + error;
+			}
+			conn.Write(FailureReply("assembly-error", message, assembleMicros));
+			return;
+		}
+		// A program the optimizer refuses is cached as it was written.
+		if (m_optimize) {
+			Optimizer optimizer;
+			ProgramImage optimized;
+			if (optimizer.Optimize(*assembled, optimized)) *assembled = optimized;
+			assembleMicros = MicrosSince(start);
+		}
+		m_cache.Insert(key, assembled);
+		image = assembled;
+	}
+
+	// With the run cache, a repeated run is replayed instead of emulated.
+	auto start = chrono::steady_clock::now();
+	RunResult result;
+	uint64_t runKey = 0;
+	bool replayed = false, cacheable = true;
+	if (m_runCache) {
+		// The server runs the classic instruction set.
+		runKey = RunCache::Key(*image, inputs, m_limits, false);
+		replayed = m_runCache->Find(runKey, result);
+	}
+	if (!replayed) {
+		unique_ptr<emulator> emul(new emulator);
+		emul->SetLimits(m_limits);
+		emul->EnableFastForward(m_fastForward);
+		result.m_status = emul->LoadImage(*image) ? emul->RunBatch(inputs, result.m_outputs, kMaxOutputs) : RS_Error;
+		result.m_steps = emul->GetStepCount();
+		result.m_message = emul->GetErrorMessage();
+		cacheable = emul->IsCacheable();
+		if (m_runCache && cacheable) m_runCache->Insert(runKey, result);
+	}
+	long long runMicros = MicrosSince(start);
+
+	conn.Write(FormatReply(StatusName(result.m_status), result, cached, replayed, cacheable, assembleMicros, runMicros));
+}
+
+/*
+NAME
+
+    RunClient - submits a program to the server.
+
+SYNOPSIS
+
+    int RunClient( const Options &a_options );
+
+DESCRIPTION
+
+    Sends only the hash of the source first; the source itself is sent only
+    if the server does not have the image.  Displays the outputs one per
+    line followed by a status line.  Returns 0 if the program halted, 2 if
+    it was stopped by the watchdog and 1 otherwise.
+*/
+int RunClient(const Options &a_options)
+{
+	signal(SIGPIPE, SIG_IGN);
+	const string &path = a_options.GetSocketPath();
+
+	if (a_options.IsQuit()) {
+		int fd = ConnectTo(path);
+		if (fd < 0) {
+			cerr << "Could not connect to " << path << endl;
+			return 1;
+		}
+		Connection conn(fd);
+		string reply;
+		return conn.Write("QUIT\n") && conn.ReadLine(reply) && reply == "BYE" ? 0 : 1;
+	}
+
+	ifstream file(a_options.GetSourceFile(), ios::in | ios::binary);
+	if (!file) {
+		cerr << "Source file could not be opened, client terminated." << endl;
+		return 1;
+	}
+	string source((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	string hashText = HashToString(Fnv1aHash(source.data(), source.size()));
+
+	string inputLine;
+	for (int value : a_options.GetInputs()) {
+		inputLine += (inputLine.empty() ? "" : " ") + to_string(value);
+	}
+
+	string status, outputLine, message;
+	for (bool withSource : { false, true }) {
+		int fd = ConnectTo(path);
+		if (fd < 0) {
+			cerr << "Could not connect to " << path << endl;
+			return 1;
+		}
+		Connection conn(fd);
+		string request = "RUN " + hashText + " " + to_string(a_options.GetInputs().size()) + " "
+			+ to_string(withSource ? source.size() : 0) + "\n" + inputLine + "\n";
+		if (withSource) request += source;
+		if (!conn.Write(request) || !conn.ReadLine(status) || !conn.ReadLine(outputLine) || !conn.ReadLine(message)) {
+			cerr << "The server did not reply." << endl;
+			return 1;
+		}
+		if (status.compare(0, 21, "STATUS unknown-image ") != 0) break;
+	}
+
+	istringstream sins(status), oins(outputLine);
+	string tag, name;
+	long long steps = 0, assembleMicros = 0, runMicros = 0;
+	int cached = 0, replayed = 0, cacheable = 0;
+	size_t count = 0;
+	sins >> tag >> name >> steps >> cached >> replayed >> cacheable >> assembleMicros >> runMicros;
+	oins >> tag >> count;
+	for (int value; oins >> value; ) {
+		cout << value << endl;
+	}
+	bool ran = name != "assembly-error" && name != "bad-request";
+	cout << "Status: " << name << ", " << steps << " instructions, image " << (cached ? "cached" : "assembled");
+	if (ran) cout << ", " << (replayed ? "result replayed" : cacheable ? "result emulated" : "result not cacheable");
+	cout << ", assembly " << assembleMicros << " us, run " << runMicros << " us." << endl;
+	if (message.size() > 8) cout << message.substr(8) << endl;
+
+	if (name == "halted") return 0;
+	if (name == "step-limit" || name == "time-limit") return 2;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,73 @@
+//
+//		Server class - a long running assembler and emulator listening on a Unix domain
+//		socket, and the client that submits programs to it.
+//
+//		Each connection carries one request and its reply, as text:
+//
+//			RUN <source hash> <input count> <source bytes>\n
+//			<inputs separated by spaces>\n
+//			<source text>
+//
+//			STATUS <status> <steps> <image cached 0|1> <result replayed 0|1>
+//				   <result cacheable 0|1> <assembly us> <run us>\n
+//			OUTPUT <output count> <outputs separated by spaces>\n
+//			MESSAGE <error message, may be empty>\n
+//
+//		The source hash is the hexadecimal Fnv1aHash of the source text.  A request may
+//		leave out the source (0 bytes); if the server does not have the image it replies
+//		with the status unknown-image and the client resends the source.  The request
+//		QUIT stops the server.  With -O, images are optimized before they are cached.
+//		With the run cache, a run of an image on inputs it has already been run on is
+//		replayed; a run stopped by a limit is not cacheable.
+//
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Emulator.h"
+#include "LruCache.h"
+#include "ProgramImage.h"
+#include "Options.h"
+#include "RunCache.h"
+#include <memory>
+
+class Server {
+
+public:
+
+	Server(const Options &a_options);
+
+	// Listens for requests until a QUIT request.  Returns the exit status of the program.
+	int Run();
+
+private:
+
+	// Takes connections off the queue and serves them.
+	void Worker();
+
+	// Reads one request from a connection and replies to it.
+	void HandleConnection(int a_fd);
+
+	string m_socketPath;			// Where the server listens.
+	int m_workerCount;				// Size of the worker pool.
+	bool m_optimize;				// Optimize images before caching them.
+	bool m_fastForward;				// Let the emulators fast forward counted loops.
+	RunLimits m_limits;				// Watchdog limits applied to every run.
+	LruCache<ProgramImage> m_cache;	// Assembled images by source hash.
+	unique_ptr<RunCache> m_runCache;	// Memoized runs, if enabled.
+	mutex m_assembleMutex;			// The assembler uses global error reporting.
+
+	mutex m_queueMutex;				// Guards the queue and m_stopping.
+	condition_variable m_queueReady;
+	deque<int> m_queue;				// Accepted connections waiting for a worker.
+	bool m_stopping;				// A QUIT request was received.
+	int m_listenFd;					// The listening socket.
+};
+
+// Submits the source file named in a_options to a server and displays the reply.
+// Returns the exit status of the program.
+int RunClient(const Options &a_options);
@@ -0,0 +1,251 @@
+//
+//  Implementation of the statistics of --stats.
+//
+#include "stdafx.h"
+#include "Stats.h"
+#include "SymTab.h"
+#include "Instruction.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+using VC370Constants::Opcode;
+
+namespace {
+	atomic<long long> s_allocations{ 0 };	// Calls of operator new.
+	atomic<long long> s_allocatedBytes{ 0 };	// Bytes they asked for.
+
+	// The cycles of the default model, by opcode.
+	const pair<Opcode, long long> kDefaultCycles[] = {
+		{ VC370Constants::OP_ADD, 1 }, { VC370Constants::OP_SUB, 1 }, { VC370Constants::OP_MULT, 3 }, { VC370Constants::OP_DIV, 10 },
+		{ VC370Constants::OP_LOAD, 2 }, { VC370Constants::OP_STORE, 2 }, { VC370Constants::OP_READ, 10 }, { VC370Constants::OP_WRITE, 10 },
+		{ VC370Constants::OP_B, 1 }, { VC370Constants::OP_BM, 1 }, { VC370Constants::OP_BZ, 1 }, { VC370Constants::OP_BP, 1 },
+		{ VC370Constants::OP_HALT, 1 },
+		{ VC370Constants::OP_LOADX, 2 }, { VC370Constants::OP_STOREX, 2 }, { VC370Constants::OP_ADDX, 2 }, { VC370Constants::OP_SETX, 1 },
+		{ VC370Constants::OP_INCX, 1 }, { VC370Constants::OP_BXLT, 1 }, { VC370Constants::OP_BCOPY, 4 }, { VC370Constants::OP_BSUM, 4 },
+		{ VC370Constants::OP_BREAD, 10 }, { VC370Constants::OP_BWRITE, 10 }, { VC370Constants::OP_SPAWN, 20 }, { VC370Constants::OP_FADD, 5 },
+		{ VC370Constants::OP_CAS, 5 }, { VC370Constants::OP_JOIN, 5 }
+	};
+
+	// The mnemonic of an opcode, or its number if it has none.
+	string OpcodeName(int a_opcode)
+	{
+		for (const auto &entry : Instruction::MachineOpcodes()) {
+			if (entry.second == a_opcode) return entry.first;
+		}
+		return to_string(a_opcode);
+	}
+
+	// A JSON string.
+	string Quoted(const string &a_text)
+	{
+		string quoted = "\"";
+		for (char ch : a_text) {
+			if (ch == '"' || ch == '\\') {
+				quoted += '\\';
+				quoted += ch;
+			} else if (static_cast<unsigned char>(ch) < 0x20) {
+				char escape[8];
+				snprintf(escape, sizeof(escape), "\\u%04x", ch);
+				quoted += escape;
+			} else {
+				quoted += ch;
+			}
+		}
+		return quoted + "\"";
+	}
+
+	const char *StatusName(RunStatus a_status)
+	{
+		switch (a_status) {
+			case RS_Halted: return "halted";
+			case RS_Error: return "error";
+			case RS_StepLimit: return "step limit";
+			case RS_TimeLimit: return "time limit";
+			default: return "not run";
+		}
+	}
+}
+
+// Every allocation of the program goes through these, so that the phases can count
+// theirs.  The other forms of new and delete call them.
+// GCC takes the free of a block from this operator new for a mismatch.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t a_size)
+{
+	s_allocations.fetch_add(1, memory_order_relaxed);
+	s_allocatedBytes.fetch_add((long long)a_size, memory_order_relaxed);
+	void *block = malloc(a_size > 0 ? a_size : 1);
+	if (block == nullptr) throw bad_alloc();
+	return block;
+}
+
+void operator delete(void *a_block) noexcept
+{
+	free(a_block);
+}
+
+void operator delete(void *a_block, size_t) noexcept
+{
+	free(a_block);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+long long GetAllocationCount()
+{
+	return s_allocations.load(memory_order_relaxed);
+}
+
+long long GetAllocatedBytes()
+{
+	return s_allocatedBytes.load(memory_order_relaxed);
+}
+
+CycleModel::CycleModel()
+	: m_cycles(kOpcodes, 0)
+{
+	for (const auto &entry : kDefaultCycles) m_cycles[entry.first] = entry.second;
+}
+
+bool CycleModel::Read(const string &a_path, string &a_error)
+{
+	ifstream in(a_path);
+	if (!in) {
+		a_error = "Cannot open the cycle model " + a_path;
+		return false;
+	}
+	string line;
+	for (int number = 1; getline(in, line); ++number) {
+		istringstream fields(line.substr(0, line.find(';')));
+		string mnemonic, rest;
+		long long cycles;
+		if (!(fields >> mnemonic)) continue;
+		if (!(fields >> cycles) || cycles < 0 || (fields >> rest) || !Instruction::IsMachineOpcode(mnemonic)) {
+			a_error = "Malformed cycle model " + a_path + " at line " + to_string(number);
+			return false;
+		}
+		m_cycles[Instruction::OpcodeToNumber(mnemonic)] = cycles;
+	}
+	return true;
+}
+
+bool CycleModel::IsIo(int a_opcode)
+{
+	return a_opcode == VC370Constants::OP_READ || a_opcode == VC370Constants::OP_WRITE
+		|| a_opcode == VC370Constants::OP_BREAD || a_opcode == VC370Constants::OP_BWRITE;
+}
+
+Stats::Phase::Phase(Stats *a_stats, const string &a_name)
+	: m_stats(a_stats), m_name(a_name), m_start(chrono::steady_clock::now()), m_allocations(GetAllocationCount()), m_bytes(GetAllocatedBytes())
+{
+}
+
+void Stats::Phase::End()
+{
+	if (m_stats == nullptr) return;
+	long long micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - m_start).count();
+	long long allocations = GetAllocationCount() - m_allocations, bytes = GetAllocatedBytes() - m_bytes;
+	m_stats->m_phases.push_back({ m_name, micros, allocations, bytes });
+	m_stats = nullptr;
+}
+
+void Stats::SetEmulation(RunStatus a_status, long long a_steps, long long a_fastForwardSteps, long long a_ioWaitMicros,
+	int a_harts, const vector<long long> &a_opcodeCounts)
+{
+	m_emulated = true;
+	m_status = a_status;
+	m_steps = a_steps;
+	m_fastForwardSteps = a_fastForwardSteps;
+	m_ioWaitMicros = a_ioWaitMicros;
+	m_harts = a_harts;
+	m_opcodeCounts = a_opcodeCounts;
+}
+
+bool Stats::Write(string &a_error) const
+{
+	if (m_path.empty()) {
+		WriteJson(cout);
+		return true;
+	}
+	ofstream out(m_path);
+	WriteJson(out);
+	if (!out) {
+		a_error = "Cannot write the statistics " + m_path;
+		return false;
+	}
+	return true;
+}
+
+/*
+NAME
+
+    WriteJson - writes the statistics as a JSON object.
+
+SYNOPSIS
+
+    void WriteJson( ostream &a_out ) const;
+
+DESCRIPTION
+
+    The emulation is only written if there was one.  Its host speed leaves out the time
+    spent waiting for input, and its estimated cycles are those of the cycle model for
+    each instruction retired, of which the I/O instructions give the I/O cycles.  The
+    model itself is written too, so that estimates of different models are not mixed up.
+*/
+void Stats::WriteJson(ostream &a_out) const
+{
+	a_out << "{" << endl << "  \"program\": " << Quoted(m_program) << "," << endl << "  \"phases\": [";
+	long long emulationMicros = 0;
+	for (size_t i = 0; i < m_phases.size(); ++i) {
+		const PhaseRecord &phase = m_phases[i];
+		a_out << (i == 0 ? "" : ",") << endl << "    { \"name\": " << Quoted(phase.m_name) << ", \"wall_us\": " << phase.m_micros
+			<< ", \"allocations\": " << phase.m_allocations << ", \"allocated_bytes\": " << phase.m_bytes << " }";
+		if (phase.m_name == "Emulation") emulationMicros = phase.m_micros;
+	}
+	a_out << endl << "  ]";
+
+	if (m_emulated) {
+		long long cycles = 0, ioCycles = 0;
+		ostringstream counts;
+		bool first = true;
+		for (int opcode = 0; opcode < int(m_opcodeCounts.size()); ++opcode) {
+			long long count = m_opcodeCounts[opcode];
+			if (count == 0) continue;
+			cycles += count * m_model.GetCycles(opcode);
+			if (CycleModel::IsIo(opcode)) ioCycles += count * m_model.GetCycles(opcode);
+			counts << (first ? "" : ", ") << Quoted(OpcodeName(opcode)) << ": " << count;
+			first = false;
+		}
+		long long runMicros = max(emulationMicros - m_ioWaitMicros, 1LL);
+		// Fast forwarded runs can retire more instructions per second than a long long holds.
+		double perSecond = min(m_steps * 1e6 / runMicros, 9e18);
+		a_out << "," << endl << "  \"emulation\": {" << endl
+			<< "    \"status\": " << Quoted(StatusName(m_status)) << "," << endl
+			<< "    \"harts\": " << m_harts << "," << endl
+			<< "    \"instructions\": " << m_steps << "," << endl
+			<< "    \"fast_forwarded\": " << m_fastForwardSteps << "," << endl
+			<< "    \"wall_us\": " << emulationMicros << "," << endl
+			<< "    \"io_wait_us\": " << m_ioWaitMicros << "," << endl
+			<< "    \"host_instructions_per_sec\": " << (long long)perSecond << "," << endl
+			<< "    \"cycles\": " << cycles << "," << endl
+			<< "    \"io_cycles\": " << ioCycles << "," << endl
+			<< "    \"cpi\": " << (m_steps > 0 ? double(cycles) / m_steps : 0.0) << "," << endl
+			<< "    \"opcodes\": { " << counts.str() << " }" << endl
+			<< "  }";
+	}
+
+	a_out << "," << endl << "  \"cycle_model\": { ";
+	bool first = true;
+	for (const auto &entry : Instruction::MachineOpcodes()) {
+		a_out << (first ? "" : ", ") << Quoted(entry.first) << ": " << m_model.GetCycles(entry.second);
+		first = false;
+	}
+	a_out << " }" << endl << "}" << endl;
+}
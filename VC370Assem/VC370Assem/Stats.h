@@ -0,0 +1,111 @@
+//
+//		Statistics of a run of the toolchain, written as JSON by --stats so that program
+//		variants and builds can be compared by the same numbers.  Each phase of the
+//		assembler and the emulation records its wall time and the heap allocations it
+//		made.  The emulation also records how many times each opcode was executed, from
+//		which a cycle model estimates the VC370 cycles the program would take.
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Emulator.h"
+using namespace std;
+
+// Heap allocations made by the whole process so far, through operator new.  The counts
+// include those of every thread, the harts and the server workers among them, so a phase
+// only counts its own while no other thread allocates.
+long long GetAllocationCount();
+long long GetAllocatedBytes();
+
+// Estimated cycles of each opcode.  A model file has a line for each opcode to change,
+// the mnemonic and its cycles.  Blank lines and text after ';' are ignored.
+class CycleModel {
+
+public:
+
+	// Opcodes are two digits.
+	static const int kOpcodes = 100;
+
+	// The default model: a cycle for a branch, more for memory and arithmetic, and most
+	// for I/O and the instructions that synchronize harts.
+	CycleModel();
+
+	// Loads a model file over the defaults.  Returns false with a message on failure.
+	bool Read(const string &a_path, string &a_error);
+
+	long long GetCycles(int a_opcode) const { return a_opcode >= 0 && a_opcode < kOpcodes ? m_cycles[a_opcode] : 0; }
+
+	// Whether the opcode waits for the outside world: READ, WRITE, BREAD and BWRITE.
+	static bool IsIo(int a_opcode);
+
+private:
+
+	vector<long long> m_cycles;		// Cycles, indexed by opcode.
+};
+
+class Stats {
+
+public:
+
+	// Writes to a_path, or to cout if it is empty.
+	explicit Stats(const string &a_path) : m_path(a_path) {}
+
+	void SetProgram(const string &a_program) { m_program = a_program; }
+	void SetCycleModel(const CycleModel &a_model) { m_model = a_model; }
+
+	// Records a phase from its construction to its destruction.  Does nothing if
+	// a_stats is null, so that phases can be marked whether or not --stats was given.
+	class Phase {
+
+	public:
+
+		Phase(Stats *a_stats, const string &a_name);
+		~Phase() { End(); }
+
+		// Ends the phase before its destruction.
+		void End();
+
+	private:
+
+		Stats *m_stats;
+		string m_name;
+		chrono::steady_clock::time_point m_start;
+		long long m_allocations;
+		long long m_bytes;
+	};
+
+	// Records what the emulation did.  a_opcodeCounts holds the executions of each opcode.
+	void SetEmulation(RunStatus a_status, long long a_steps, long long a_fastForwardSteps, long long a_ioWaitMicros,
+		int a_harts, const vector<long long> &a_opcodeCounts);
+
+	// Writes the statistics.  Returns false with a message on failure.
+	bool Write(string &a_error) const;
+
+private:
+
+	struct PhaseRecord {
+		string m_name;
+		long long m_micros;			// Wall time.
+		long long m_allocations;	// Heap allocations.
+		long long m_bytes;			// Bytes they asked for.
+	};
+
+	// Writes the JSON text.
+	void WriteJson(ostream &a_out) const;
+
+	string m_path;					// Where to write, or empty for cout.
+	string m_program;				// The source file.
+	CycleModel m_model;				// Cycles of each opcode.
+	vector<PhaseRecord> m_phases;	// In the order they ended.
+
+	bool m_emulated = false;		// SetEmulation was called.
+	RunStatus m_status = RS_NotRun;
+	long long m_steps = 0;			// Instructions retired.
+	long long m_fastForwardSteps = 0;	// Of which fast forwarded.
+	long long m_ioWaitMicros = 0;	// Wall time waiting for input.
+	int m_harts = 1;				// Harts of the run.
+	vector<long long> m_opcodeCounts;	// Executions, indexed by opcode.
+};
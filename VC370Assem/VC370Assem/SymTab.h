@@ -27,6 +27,13 @@ public:
     // Lookup a symbol in the symbol table.
     bool LookupSymbol( string &a_symbol, int &a_loc );
 
+    // Remove a symbol that is no longer defined, or move one that is.
+    void RemoveSymbol( const string &a_symbol ) { m_symbolTable.erase( a_symbol ); }
+    void MoveSymbol( const string &a_symbol, int a_loc ) { m_symbolTable[a_symbol] = a_loc; }
+
+    // All the symbols and their locations.
+    const map<string, int> &GetSymbols( ) const { return m_symbolTable; }
+
     static const int MAX_MEMORY = VC370Constants::kMaxMemory;
 private:
 
@@ -5,4 +5,27 @@
 
 namespace VC370Constants {
     const int kMaxMemory = 10'000;
+
+    // The largest memory that --memory may select.  The memory size is a power of ten,
+    // and an opcode of two digits must still fit in front of an address in an int.
+    const int kMaxWideMemory = 10'000'000;
+
+    // Opcodes of the machine language instructions.  A word is opcode * kMaxMemory + address,
+    // or opcode * the memory size + address in a wider memory.  The opcodes after OP_HALT
+    // are the extended instruction set, which adds an index register X, block operations and
+    // the instructions of a multiprocessor.
+    enum Opcode {
+        OP_ADD = 1, OP_SUB, OP_MULT, OP_DIV, OP_LOAD, OP_STORE, OP_READ, OP_WRITE,
+        OP_B, OP_BM, OP_BZ, OP_BP, OP_HALT,
+        OP_LOADX, OP_STOREX, OP_ADDX, OP_SETX, OP_INCX, OP_BXLT, OP_BCOPY, OP_BSUM,
+        OP_BREAD, OP_BWRITE, OP_SPAWN, OP_FADD, OP_CAS, OP_JOIN
+    };
+
+    // The digits of an address in a memory of a_memorySize words, a power of ten.
+    inline int AddressDigits(int a_memorySize)
+    {
+        int digits = 0;
+        for (int size = a_memorySize; size > 1; size /= 10) digits++;
+        return digits;
+    }
 }
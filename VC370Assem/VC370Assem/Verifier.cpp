@@ -0,0 +1,392 @@
+//
+//  Implementation of the engine verifier.
+//
+#include "stdafx.h"
+#include "Verifier.h"
+#include "Assembler.h"
+#include <random>
+#include <sstream>
+
+using namespace VC370Constants;
+
+namespace {
+	const long long kStressSteps = 1'000'000;	// Instruction limit of a random program if none is given.
+	const char *const kEventNames[] = { "READ", "WRITE", "block READ", "block WRITE", "yield", "HALT", "error", "watchdog stop", "break", "SPAWN", "JOIN" };
+
+	bool Ends(EmulatorEvent a_event) { return a_event == EV_Halt || a_event == EV_Error || a_event == EV_Limit; }
+
+	// Supplies the inputs from a_next on that a READ or BREAD is waiting for, as far as
+	// there are any, and returns the index of the next unused input.
+	size_t Supply(Engine &a_engine, EmulatorEvent a_event, const vector<int> &a_inputs, size_t a_next)
+	{
+		if (a_event == EV_Read && a_next < a_inputs.size()) {
+			a_engine.SupplyInput(a_inputs[a_next++]);
+		} else if (a_event == EV_ReadBlock) {
+			int count = int(min<size_t>(a_engine.GetIoCount(), a_inputs.size() - a_next));
+			a_engine.SupplyInputs(a_inputs.data() + a_next, count);
+			a_next += count;
+		}
+		return a_next;
+	}
+
+	// Writes random programs for the stress mode: straight line arithmetic, counted loops
+	// that can be fast forwarded and ones that cannot, forward branches, READ and WRITE.
+	class RandomProgram {
+
+	public:
+
+		explicit RandomProgram(mt19937 &a_random) : m_random(a_random) {}
+
+		string Generate()
+		{
+			m_source << "        ORG  100" << endl;
+			Emit("READ", "I0");
+			Emit("READ", "I1");
+			for (int segments = Pick(2, 6); segments > 0; --segments) {
+				switch (Pick(0, 3)) {
+					case 0: Arithmetic(Pick(1, 6)); break;
+					case 1: Loop(); break;
+					case 2: Choice(); break;
+					default: Emit("WRITE", Variable()); break;
+				}
+			}
+			Emit("WRITE", "V0");
+			Emit("HALT", "");
+			for (int i = 0; i < kVariables; ++i) {
+				Data("V" + to_string(i), Pick(0, 1) ? "DS" : "DC", Pick(0, 1) ? 1 : Pick(0, 99));
+				Data("K" + to_string(i), "DC", i < 2 ? Pick(1, 9) : Pick(1, 999));
+			}
+			for (int i = 0; i < m_loops; ++i) Data("N" + to_string(i), "DS", 1);
+			Data("I0", "DS", 1);
+			Data("I1", "DS", 1);
+			Data("ONE", "DC", 1);
+			m_source << "        END" << endl;
+			return m_source.str();
+		}
+
+	private:
+
+		static const int kVariables = 4;	// Variables and constants of each program.
+
+		int Pick(int a_low, int a_high) { return uniform_int_distribution<int>(a_low, a_high)(m_random); }
+		string Variable() { return "V" + to_string(Pick(0, kVariables - 1)); }
+		string Constant() { return "K" + to_string(Pick(0, kVariables - 1)); }
+		string Operand() { return Pick(0, 4) == 0 ? "I" + to_string(Pick(0, 1)) : Pick(0, 1) ? Variable() : Constant(); }
+		string Branch() { const char *branches[] = { "BM", "BZ", "BP" }; return branches[Pick(0, 2)]; }
+
+		// A statement, with the label waiting for the next one if there is one.
+		void Emit(const string &a_opcode, const string &a_operand)
+		{
+			m_source << m_label << string(max<size_t>(1, 8 - m_label.size()), ' ') << a_opcode;
+			if (!a_operand.empty()) m_source << string(max<size_t>(1, 5 - a_opcode.size()), ' ') << a_operand;
+			m_source << endl;
+			m_label.clear();
+		}
+
+		void Data(const string &a_label, const string &a_opcode, int a_value)
+		{
+			m_source << a_label << string(max<size_t>(1, 8 - a_label.size()), ' ') << a_opcode << "   " << a_value << endl;
+		}
+
+		// Arithmetic on variables and constants.  Division is only by constants, which
+		// are never zero.
+		void Arithmetic(int a_count)
+		{
+			for (int i = 0; i < a_count; ++i) {
+				switch (Pick(0, 9)) {
+					case 0: case 1: Emit("LOAD", Operand()); break;
+					case 2: case 3: Emit("ADD", Operand()); break;
+					case 4: case 5: Emit("SUB", Operand()); break;
+					case 6: Emit("MULT", Pick(0, 3) ? Constant() : Operand()); break;
+					case 7: Emit("DIV", Constant()); break;
+					default: Emit("STORE", Variable()); break;
+				}
+			}
+		}
+
+		// A loop counting down from a constant or the product of two, which may also be
+		// left early.
+		void Loop()
+		{
+			string counter = "N" + to_string(m_loops), head = "L" + to_string(m_loops), exit = "X" + to_string(m_loops);
+			m_loops++;
+			Emit("LOAD", Constant());
+			if (Pick(0, 1)) Emit("MULT", Constant());
+			Emit("STORE", counter);
+			m_label = head;
+			Arithmetic(Pick(1, 6));
+			if (Pick(0, 3) == 0) Emit(Branch(), exit);
+			Emit("LOAD", counter);
+			Emit("SUB", "ONE");
+			Emit("STORE", counter);
+			if (Pick(0, 2)) {
+				Emit("BP", head);
+			} else {
+				Emit("BZ", exit);
+				Emit("B", head);
+			}
+			m_label = exit;
+		}
+
+		// A forward branch around some arithmetic.
+		void Choice()
+		{
+			string skip = "S" + to_string(m_choices++);
+			Emit("LOAD", Variable());
+			Emit(Branch(), skip);
+			Arithmetic(Pick(1, 3));
+			m_label = skip;
+		}
+
+		mt19937 &m_random;
+		ostringstream m_source;
+		string m_label;			// Label of the next statement.
+		int m_loops = 0;
+		int m_choices = 0;
+	};
+}
+
+/*
+NAME
+
+    Verify - runs a program with the reference engine and the engine under test.
+
+SYNOPSIS
+
+    bool Verify( const ProgramImage &a_image, const vector<int> &a_inputs );
+
+DESCRIPTION
+
+    Both engines run with a slice of m_interval instructions, so that they yield on
+    the same back edges, and the event, instruction count, location, accumulator and
+    a hash of the memory are compared each time they return.  Only when these differ
+    is the run repeated to find the instruction responsible, so agreeing runs cost
+    little more than running both engines.
+*/
+bool EngineVerifier::Verify( const ProgramImage &a_image, const vector<int> &a_inputs )
+{
+	m_mismatch.clear();
+	m_steps = 0;
+	m_comparisons = 0;
+	unique_ptr<Engine> reference = Launch("reference", a_image), tested = Launch(m_engine, a_image);
+	if (!reference || !tested) {
+		m_mismatch = "The " + m_engine + " engine could not be started on the program.\n";
+		return false;
+	}
+	size_t next = 0;
+	while (true) {
+		EmulatorEvent referenceEvent = reference->Execute();
+		EmulatorEvent testedEvent = tested->Execute();
+		m_comparisons++;
+		if (!Compare(*reference, referenceEvent, *tested, testedEvent).empty()) {
+			Locate(a_image, a_inputs, *tested, testedEvent);
+			return false;
+		}
+		m_steps = reference->GetStepCount();
+		if (Ends(referenceEvent)) return true;
+		Supply(*tested, referenceEvent, a_inputs, next);
+		next = Supply(*reference, referenceEvent, a_inputs, next);
+	}
+}
+
+unique_ptr<Engine> EngineVerifier::Launch( const string &a_name, const ProgramImage &a_image ) const
+{
+	unique_ptr<Engine> engine = MakeEngine(a_name);
+	if (!engine || !engine->LoadImage(a_image)) return nullptr;
+	engine->SetLimits(m_limits);
+	engine->SetSlice(m_interval);
+	engine->EnableExtended(m_extended);
+	engine->Reset();
+	return engine;
+}
+
+size_t EngineVerifier::Advance( Engine &a_engine, long long a_times, const vector<int> &a_inputs )
+{
+	size_t next = 0;
+	for (long long i = 0; i < a_times; ++i) {
+		next = Supply(a_engine, a_engine.Execute(), a_inputs, next);
+	}
+	return next;
+}
+
+string EngineVerifier::Compare( const Engine &a_reference, EmulatorEvent a_referenceEvent, const Engine &a_tested, EmulatorEvent a_testedEvent ) const
+{
+	auto Differ = [this](const string &a_what, const string &a_reference, const string &a_tested) {
+		return a_what + " is " + a_reference + " in the reference engine and " + a_tested + " in " + m_engine + ".";
+	};
+	if (a_referenceEvent != a_testedEvent) {
+		return Differ("The reason for returning", kEventNames[a_referenceEvent], kEventNames[a_testedEvent]);
+	}
+	if (a_reference.GetStepCount() != a_tested.GetStepCount()) {
+		return Differ("The instruction count", to_string(a_reference.GetStepCount()), to_string(a_tested.GetStepCount()));
+	}
+	if (a_reference.GetLocation() != a_tested.GetLocation()) {
+		return Differ("The location of the next instruction", to_string(a_reference.GetLocation()), to_string(a_tested.GetLocation()));
+	}
+	if (a_reference.GetAccumulator() != a_tested.GetAccumulator()) {
+		return Differ("The accumulator", to_string(a_reference.GetAccumulator()), to_string(a_tested.GetAccumulator()));
+	}
+	if (a_reference.GetIndex() != a_tested.GetIndex()) {
+		return Differ("The index register", to_string(a_reference.GetIndex()), to_string(a_tested.GetIndex()));
+	}
+	if (a_reference.GetMemoryHash() != a_tested.GetMemoryHash()) {
+		for (int loc = 0; loc < kMaxMemory; ++loc) {
+			if (a_reference.GetMemory(loc) != a_tested.GetMemory(loc)) {
+				return Differ("Location " + to_string(loc), to_string(a_reference.GetMemory(loc)), to_string(a_tested.GetMemory(loc)));
+			}
+		}
+	}
+	return "";
+}
+
+/*
+NAME
+
+    Locate - finds the first instruction on which the engines disagree.
+
+SYNOPSIS
+
+    void Locate( const ProgramImage &a_image, const vector<int> &a_inputs, const Engine &a_tested, EmulatorEvent a_testedEvent );
+
+DESCRIPTION
+
+    Both engines are run again to the last comparison on which they agreed.  If the
+    engine under test steps the way it executes, both are then stepped together and
+    the first instruction after which they differ is the one reported.  Otherwise the
+    reference engine is stepped alone to the instruction count at which the engine
+    under test disagreed, a_tested, and the report names the instruction that last
+    changed the accumulator or the memory location that differs.
+*/
+void EngineVerifier::Locate( const ProgramImage &a_image, const vector<int> &a_inputs, const Engine &a_tested, EmulatorEvent a_testedEvent )
+{
+	unique_ptr<Engine> reference = Launch("reference", a_image), tested = Launch(m_engine, a_image);
+	size_t next = Advance(*reference, m_comparisons - 1, a_inputs);
+	Advance(*tested, m_comparisons - 1, a_inputs);
+	long long agreed = reference->GetStepCount();
+	m_mismatch = "The engines agree up to instruction " + to_string(agreed) + ".\n";
+
+	if (tested->StepsExactly()) {
+		while (true) {
+			int loc = reference->GetLocation();
+			EmulatorEvent referenceEvent = reference->Step();
+			EmulatorEvent testedEvent = tested->Step();
+			string difference = Compare(*reference, referenceEvent, *tested, testedEvent);
+			if (!difference.empty()) {
+				m_mismatch += "First mismatch at instruction " + to_string(reference->GetStepCount()) + ", " + Describe(a_image, loc) + ".\n" + difference + "\n";
+				return;
+			}
+			if (Ends(referenceEvent)) break;
+			Supply(*tested, referenceEvent, a_inputs, next);
+			next = Supply(*reference, referenceEvent, a_inputs, next);
+		}
+		m_mismatch += "They only disagree when not stepped: " + Compare(*reference, EV_Yield, a_tested, a_testedEvent) + "\n";
+		return;
+	}
+
+	// What last changed the accumulator and each location, as the step and location.
+	pair<long long, int> accumChanged(0, -1);
+	map<int, pair<long long, int>> memoryChanged;
+	EmulatorEvent referenceEvent = EV_Yield;
+	while (reference->GetStepCount() < a_tested.GetStepCount() && !Ends(referenceEvent)) {
+		int loc = reference->GetLocation();
+		int opcode = reference->GetMemory(loc) / kMaxMemory, address = reference->GetMemory(loc) % kMaxMemory;
+		referenceEvent = reference->Step();
+		pair<long long, int> change(reference->GetStepCount(), loc);
+		if ((opcode >= OP_ADD && opcode <= OP_LOAD) || opcode == OP_LOADX || opcode == OP_ADDX || opcode == OP_BSUM
+			|| opcode == OP_FADD || opcode == OP_CAS) accumChanged = change;
+		if (opcode == OP_STORE || opcode == OP_READ || opcode == OP_FADD || opcode == OP_CAS) memoryChanged[address] = change;
+		if (referenceEvent == EV_ReadBlock) {
+			for (int i = 0; i < reference->GetIoCount(); ++i) memoryChanged[address + i] = change;
+		}
+		next = Supply(*reference, referenceEvent, a_inputs, next);
+	}
+	string difference = Compare(*reference, referenceEvent, a_tested, a_testedEvent);
+	m_mismatch += "After instruction " + to_string(reference->GetStepCount()) + ": " + difference + "\n";
+
+	pair<long long, int> change(0, -1);
+	string what;
+	if (reference->GetAccumulator() != a_tested.GetAccumulator()) {
+		change = accumChanged;
+		what = "the accumulator";
+	} else {
+		for (int loc = 0; loc < kMaxMemory && what.empty(); ++loc) {
+			if (reference->GetMemory(loc) == a_tested.GetMemory(loc)) continue;
+			what = "location " + to_string(loc);
+			if (memoryChanged.count(loc)) change = memoryChanged[loc];
+		}
+	}
+	if (change.second >= 0) {
+		m_mismatch += "The reference engine last changed " + what + " at instruction " + to_string(change.first) + ", " + Describe(a_image, change.second) + ".\n";
+	} else if (!what.empty()) {
+		m_mismatch += "The reference engine did not change " + what + " after instruction " + to_string(agreed) + ".\n";
+	}
+}
+
+void EngineVerifier::DisplayMismatch( ostream &a_out ) const
+{
+	istringstream lines(m_mismatch);
+	string line;
+	while (getline(lines, line)) a_out << "[Verify] " << line << endl;
+}
+
+string EngineVerifier::Describe( const ProgramImage &a_image, int a_loc )
+{
+	string text = "location " + to_string(a_loc);
+	const ProgramImage::Statement *statement = a_image.StatementAt(a_loc);
+	if (statement == nullptr) return text;
+	string source = statement->m_source.substr(0, statement->m_source.find(';'));
+	size_t first = source.find_first_not_of(" \t"), last = source.find_last_not_of(" \t\r");
+	if (first == string::npos) return text;
+	return text + ": " + source.substr(first, last - first + 1);
+}
+
+/*
+NAME
+
+    VerifyEnginesOnRandomPrograms - the stress mode of the verifier.
+
+SYNOPSIS
+
+    int VerifyEnginesOnRandomPrograms( const Options &a_options );
+
+DESCRIPTION
+
+    Generates the number of programs given by --stress from the seed given by --seed,
+    assembles each with AssembleText and verifies every selected engine on it with two
+    random inputs.  Random programs may well loop forever, so they are stopped after
+    kStressSteps instructions unless --max-steps or --max-time say otherwise.  The
+    first program on which the engines disagree is displayed with its inputs, so that
+    it can be saved and run with --verify-engines again.
+*/
+int VerifyEnginesOnRandomPrograms( const Options &a_options )
+{
+	RunLimits limits = a_options.GetLimits();
+	if (limits.maxSteps == 0 && limits.maxMillis == 0) limits.maxSteps = kStressSteps;
+	mt19937 random(a_options.GetStressSeed());
+	long long steps = 0;
+	for (int program = 0; program < a_options.GetStressPrograms(); ++program) {
+		string source = RandomProgram(random).Generate();
+		vector<int> inputs;
+		for (int i = 0; i < 2; ++i) inputs.push_back(uniform_int_distribution<int>(-99, 999)(random));
+		ProgramImage image;
+		vector<string> errors;
+		if (!Assembler::AssembleText(source, image, errors)) {
+			cout << "[Verify] Random program " << program << " does not assemble: " << errors.front() << endl << source;
+			return 1;
+		}
+		for (const string &engine : a_options.GetVerifyEngines()) {
+			// The random programs only use the classic instruction set.
+			EngineVerifier verifier(engine, a_options.GetVerifyInterval(), limits, false);
+			if (!verifier.Verify(image, inputs)) {
+				cout << "[Verify] The reference and " << engine << " engines disagree on random program "
+					 << program << " with inputs " << inputs[0] << "," << inputs[1] << ":" << endl << source;
+				verifier.DisplayMismatch(cout);
+				return 1;
+			}
+			steps += verifier.GetSteps();
+		}
+	}
+	cout << "[Verify] The engines agree on " << a_options.GetStressPrograms() << " random programs ("
+		 << steps << " instructions)." << endl;
+	return 0;
+}
@@ -0,0 +1,68 @@
+//
+//		Engine verifier - runs the reference engine and another engine side by side on the
+//		same program and inputs, compares them each time they yield and, if they come to
+//		disagree, finds the instruction where that started.  Selected by --verify-engines,
+//		on the source file or, with --stress, on random programs.
+//
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Engine.h"
+#include "Options.h"
+
+class EngineVerifier {
+
+public:
+
+	// Compares the engine named a_engine with the reference engine about every
+	// a_interval instructions, running both under a_limits, and with the extended
+	// instruction set if a_extended.
+	EngineVerifier(const string &a_engine, long long a_interval, const RunLimits &a_limits, bool a_extended)
+		: m_engine(a_engine), m_interval(a_interval), m_limits(a_limits), m_extended(a_extended) {}
+
+	// Runs a_image on a_inputs with both engines.  Returns false if they disagree;
+	// GetMismatch then says where and how, a line per item.
+	bool Verify(const ProgramImage &a_image, const vector<int> &a_inputs);
+
+	const string &GetMismatch() const { return m_mismatch; }
+
+	// Displays GetMismatch, marking each line as coming from the verifier.
+	void DisplayMismatch(ostream &a_out) const;
+
+	// The instructions the engines were compared on and the number of comparisons.
+	long long GetSteps() const { return m_steps; }
+	long long GetComparisons() const { return m_comparisons; }
+
+private:
+
+	// Creates an engine ready to run a_image, or returns null if it cannot.
+	unique_ptr<Engine> Launch(const string &a_name, const ProgramImage &a_image) const;
+
+	// Lets an engine return a_times, supplying the inputs it reads.  Returns the index of
+	// the next input.
+	static size_t Advance(Engine &a_engine, long long a_times, const vector<int> &a_inputs);
+
+	// How the engines differ after returning the events given, or empty if they agree.
+	string Compare(const Engine &a_reference, EmulatorEvent a_referenceEvent, const Engine &a_tested, EmulatorEvent a_testedEvent) const;
+
+	// Runs both engines again up to the last comparison on which they agreed, and then an
+	// instruction at a time to find where they first disagree, recording it in m_mismatch.
+	void Locate(const ProgramImage &a_image, const vector<int> &a_inputs, const Engine &a_tested, EmulatorEvent a_testedEvent);
+
+	// The instruction at a location, with the statement it came from.
+	static string Describe(const ProgramImage &a_image, int a_loc);
+
+	string m_engine;			// The engine under test.
+	long long m_interval;		// Instructions between comparisons.
+	RunLimits m_limits;			// Limits of both engines.
+	bool m_extended;			// Both engines execute the extended instruction set.
+	string m_mismatch;			// Where and how the engines disagree.
+	long long m_steps = 0;		// Instructions compared.
+	long long m_comparisons = 0;	// Times the engines were compared.
+};
+
+// Verifies the engines selected by the options on random programs and displays the
+// outcome.  Returns the exit status.
+int VerifyEnginesOnRandomPrograms(const Options &a_options);
@@ -0,0 +1,25 @@
+; Demo 7: Read N (1 to 1000), fill a table with 1..N, copy it and add up the copy.
+; Needs --extended for the index register and the block instructions.
+        ORG  100
+        READ N
+FILL    LOAD VAL
+        ADD  ONE
+        STORE VAL
+        STOREX TABLE    ; TABLE + X = X + 1
+        INCX 1
+        LOAD N
+        BXLT FILL       ; Until X = N.
+        SETX TABLE      ; The copy comes from TABLE.
+        LOAD N
+        BCOPY COPY
+        BSUM COPY       ; N is still in the accumulator.
+        STORE SUM
+        WRITE SUM
+        HALT
+N       DS   1
+VAL     DC   0
+ONE     DC   1
+SUM     DS   1
+TABLE   DS   1000
+COPY    DS   1000
+        END
@@ -0,0 +1,15 @@
+; Demo 8: Read N (1 to 5000) and then N values in one block, echo them and write their sum.
+; Needs --extended for the block I/O instructions.
+        ORG  100
+        READ N
+        LOAD N
+        BREAD DATA      ; N values into DATA.
+        BWRITE DATA     ; The accumulator still holds N.
+        BSUM DATA
+        STORE SUM
+        WRITE SUM
+        HALT
+N       DS   1
+SUM     DS   1
+DATA    BUF  5000
+        END
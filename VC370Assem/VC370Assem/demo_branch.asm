@@ -1,19 +1,19 @@
 ; Demo 3: Read two numbers and output |A - B|.
         ORG 100
         READ A
-        READ B
+        READ BB
         LOAD A
-        SUB  B
+        SUB  BB
         BM   NEG
         STORE DIFF
         WRITE DIFF
         HALT
-NEG     LOAD B
+NEG     LOAD BB
         SUB  A
         STORE DIFF
         WRITE DIFF
         HALT
 A       DS   1
-B       DS   1
+BB      DS   1
 DIFF    DS   1
         END
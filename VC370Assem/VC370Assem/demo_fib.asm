@@ -8,23 +8,23 @@
         LOAD ZERO
         STORE A
         LOAD ONE
-        STORE B
+        STORE BB
         LOAD N
         SUB  ONE
         STORE COUNT
 LOOP    LOAD A
-        ADD  B
+        ADD  BB
         STORE TEMP
-        LOAD B
+        LOAD BB
         STORE A
         LOAD TEMP
-        STORE B
+        STORE BB
         LOAD COUNT
         SUB  ONE
         STORE COUNT
         BZ   DONE
         BP   LOOP
-DONE    WRITE B
+DONE    WRITE BB
         HALT
 ZEROCASE LOAD ZERO
         WRITE ZERO
@@ -33,7 +33,7 @@ ONECASE LOAD ONE
         WRITE ONE
         HALT
 A       DS   1
-B       DS   1
+BB      DS   1
 TEMP    DS   1
 COUNT   DS   1
 N       DS   1
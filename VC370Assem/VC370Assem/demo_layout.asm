@@ -0,0 +1,27 @@
+; Demo 5: Read N and count down, telling the last 900 steps from the others.
+; The common case is out of line, which --profile-use corrects.
+        ORG 100
+        READ N
+LOOP    LOAD N
+        BZ   DONE
+        SUB  ONE
+        STORE N
+        SUB  LIMIT
+        BM   SMALL
+        LOAD BIG
+        ADD  ONE
+        STORE BIG
+        B    LOOP
+SMALL   LOAD SUM
+        ADD  ONE
+        STORE SUM
+        B    LOOP
+DONE    WRITE SUM
+        WRITE BIG
+        HALT
+N       DS   1
+SUM     DS   1
+BIG     DS   1
+ONE     DC   1
+LIMIT   DC   900
+        END
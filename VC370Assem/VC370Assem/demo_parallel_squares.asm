@@ -0,0 +1,112 @@
+; Demo 10: Sum the squares of 1..N modulo 9973 on four worker harts, N a multiple of 4.
+; Each worker adds up its quarter, keeping every word below the modulus, whose square
+; fits in a word, then adds the result to TOTAL under a lock taken with CAS and released
+; with FADD.  Needs --extended --harts=5.  N = 20000000 writes 9694, and N = 4000
+; writes 1597.
+        ORG  100
+        READ N
+        LOAD N
+        DIV  FOUR
+        STORE CHUNK
+        SETX BLOCKS     ; Worker k keeps its words at BLOCKS + 32k.
+        LOAD ONE
+        STORE NEXT
+        LOAD FOUR
+        STORE LEFT
+SPAWNS  LOAD NEXT
+        STOREX 0        ; Its first number i.
+        DIV  MOD
+        MULT MOD
+        STORE WHOLE
+        LOAD NEXT
+        SUB  WHOLE
+        STORE REM       ; i % MOD.
+        MULT REM
+        STORE PART
+        DIV  MOD
+        MULT MOD
+        STORE WHOLE
+        LOAD PART
+        SUB  WHOLE
+        STOREX 4        ; i * i % MOD.
+        LOAD REM
+        ADD  REM
+        ADD  ONE
+        SUB  MOD
+        BM   STEP
+        SUB  MOD
+STEP    ADD  MOD
+        STOREX 3        ; (2i + 1) % MOD, the step to the next square.
+        LOAD NEXT
+        ADD  CHUNK
+        STORE NEXT
+        LOAD ZERO
+        SUB  NEXT
+        STOREX 1        ; Minus one past its last number.
+        LOAD ZERO
+        STOREX 2        ; Its sum so far.
+        SPAWN WORK      ; With this X.
+        INCX 32         ; Apart, so that the workers do not share cache lines.
+        LOAD LEFT
+        SUB  ONE
+        STORE LEFT
+        BP   SPAWNS
+        JOIN            ; Until the workers have halted.
+        LOAD TOTAL      ; Below 4 * MOD.
+        DIV  MOD
+        MULT MOD
+        STORE WHOLE
+        LOAD TOTAL
+        SUB  WHOLE
+        STORE TOTAL
+        WRITE TOTAL
+        HALT
+WORK    LOADX 4
+        ADDX 2
+        STOREX 2        ; Add i * i.
+        SUB  MOD
+        BM   ADDED
+        STOREX 2
+ADDED   LOADX 4
+        ADDX 3
+        STOREX 4        ; The next square.
+        SUB  MOD
+        BM   SQUARED
+        STOREX 4
+SQUARED LOADX 3
+        ADD  TWO
+        STOREX 3
+        SUB  MOD
+        BM   STEPPED
+        STOREX 3
+STEPPED LOADX 0
+        ADD  ONE
+        STOREX 0
+        ADDX 1
+        BM   WORK
+LOCKIT  LOAD ZERO
+        CAS  LOCK       ; If LOCK is 0, it becomes the word at X, which is positive.
+        BP   LOCKIT     ; Another worker holds it.
+        LOAD TOTAL
+        ADDX 2
+        STORE TOTAL
+        LOAD ZERO
+        SUB  LOCK
+        FADD LOCK       ; Back to 0.  A STORE would not release the lock.
+        HALT
+N       DS   1
+CHUNK   DS   1
+NEXT    DS   1
+LEFT    DS   1
+TOTAL   DC   0
+LOCK    DC   0
+WHOLE   DS   1
+REM     DS   1
+PART    DS   1
+ZERO    DC   0
+ONE     DC   1
+TWO     DC   2
+FOUR    DC   4
+MOD     DC   9973
+BLOCKS  DS   128
+        END
@@ -0,0 +1,72 @@
+; Demo 9: Sum 1..N modulo 100000007 on four worker harts, N a multiple of 4 below the
+; modulus.  Each worker adds up its quarter with its own words at X, X + 1 and X + 2,
+; keeping its sum below the modulus so that no word overflows, and adds the result to
+; TOTAL with FADD.  Needs --extended --harts=5.  N = 40000000 writes 64000007, and
+; N = 4000 writes 8002000.
+        ORG  100
+        LOAD TENK
+        MULT TENK
+        ADD  SEVEN
+        STORE MOD       ; 100000007, too large for a DC.
+        READ N
+        LOAD N
+        DIV  FOUR
+        STORE CHUNK
+        SETX BLOCKS     ; Worker k keeps its words at BLOCKS + 32k.
+        LOAD ONE
+        STORE NEXT
+        LOAD FOUR
+        STORE LEFT
+SPAWNS  LOAD NEXT
+        STOREX 0        ; Its first number.
+        ADD  CHUNK
+        STORE NEXT
+        LOAD ZERO
+        SUB  NEXT
+        STOREX 1        ; Minus one past its last number.
+        LOAD ZERO
+        STOREX 2        ; Its sum so far.
+        SPAWN WORK      ; With this X.
+        INCX 32         ; Apart, so that the workers do not share cache lines.
+        LOAD LEFT
+        SUB  ONE
+        STORE LEFT
+        BP   SPAWNS
+        JOIN            ; Until the workers have halted.
+        LOAD TOTAL      ; Below 4 * MOD.
+        DIV  MOD
+        MULT MOD
+        STORE WHOLE
+        LOAD TOTAL
+        SUB  WHOLE
+        STORE TOTAL
+        WRITE TOTAL
+        HALT
+WORK    LOADX 0
+        ADDX 2
+        STOREX 2        ; Below 2 * MOD.
+        SUB  MOD
+        BM   ADDED
+        STOREX 2
+ADDED   LOADX 0
+        ADD  ONE
+        STOREX 0
+        ADDX 1
+        BM   WORK
+        LOADX 2
+        FADD TOTAL
+        HALT
+N       DS   1
+CHUNK   DS   1
+NEXT    DS   1
+LEFT    DS   1
+TOTAL   DC   0
+WHOLE   DS   1
+ZERO    DC   0
+ONE     DC   1
+FOUR    DC   4
+TENK    DC   10000
+SEVEN   DC   7
+MOD     DS   1
+BLOCKS  DS   128
+        END
@@ -1,13 +1,13 @@
 ; Demo 1: Read two numbers and output their sum.
         ORG 100
         READ A
-        READ B
+        READ BB
         LOAD A
-        ADD  B
+        ADD  BB
         STORE SUM
         WRITE SUM
         HALT
 A       DS   1
-B       DS   1
+BB      DS   1
 SUM     DS   1
         END
@@ -0,0 +1,19 @@
+; Demo 6: Read N and add N + (N-1) + ... + 1, with the data five million words up.
+; Needs --memory=10000000; only the two pages the program touches are allocated.
+        ORG 100
+        READ N
+LOOP    LOAD N
+        BZ   DONE
+        ADD  SUM
+        STORE SUM
+        LOAD N
+        SUB  ONE
+        STORE N
+        B    LOOP
+DONE    WRITE SUM
+        HALT
+        ORG  4999889
+N       DS   1
+SUM     DS   1
+ONE     DC   1
+        END
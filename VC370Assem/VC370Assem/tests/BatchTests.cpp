@@ -0,0 +1,58 @@
+//
+//		Tests of the runs on --inputs, whose outputs are passed on as they are written.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "Emulator.h"
+#include <memory>
+
+namespace {
+
+	// A program that writes 1 without end.
+	const char *const kWriter =
+		"        ORG     100\n"
+		"LOOP    WRITE   ONE\n"
+		"        B       LOOP\n"
+		"ONE     DC      1\n"
+		"        END\n";
+
+	// The values of a program that never halts reach the caller before the watchdog
+	// stops it, and are not kept by the emulator.
+	void TestStreamEndlessWriter()
+	{
+		unique_ptr<emulator> emul(new emulator);
+		emul->LoadImage(Assemble(kWriter));
+		RunLimits limits;
+		limits.maxSteps = 2'000'000;
+		emul->SetLimits(limits);
+
+		long long written = 0;
+		bool ones = true;
+		RunStatus status = emul->StreamBatch({}, [&]( const int *a_values, size_t a_count ) {
+			for (size_t i = 0; i < a_count; ++i) ones = ones && a_values[i] == 1;
+			written += a_count;
+		});
+		Check(status == RS_StepLimit, "an endless writer stops at the step limit");
+		Check(written == limits.maxSteps / 2 && ones, "every value written reaches the caller: " + to_string(written));
+	}
+
+	// The output limit stops the run once the values passed on would exceed it.
+	void TestStreamOutputLimit()
+	{
+		unique_ptr<emulator> emul(new emulator);
+		emul->LoadImage(Assemble(kWriter));
+
+		size_t written = 0;
+		RunStatus status = emul->StreamBatch({}, [&]( const int *, size_t a_count ) { written += a_count; }, 1000);
+		Check(status == RS_Error && written == 1000, "the output limit stops an endless writer");
+		Check(emul->GetErrorMessage().find("Output limit of 1000 values reached at location 100") != string::npos,
+			"the output limit is reported: " + emul->GetErrorMessage());
+		Check(!emul->IsCacheable(), "a run stopped by the output limit is not cached");
+
+		vector<int> outputs;
+		Check(emul->RunBatch({}, outputs, 1000) == RS_Error && outputs == vector<int>(1000, 1),
+			"RunBatch keeps the values written before the output limit");
+	}
+}
+
+const TestSuite kSuite("batch runs", { TestStreamEndlessWriter, TestStreamOutputLimit });
@@ -0,0 +1,65 @@
+//
+//		Tests of the extended instruction set and the block copy of the paged memory.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "Emulator.h"
+#include "Memory.h"
+#include <cstring>
+#include <memory>
+#include <random>
+
+namespace {
+
+	// The extended opcodes are illegal unless enabled.
+	void TestExtendedOpcodes()
+	{
+		ProgramImage image = Assemble(
+			"        ORG     100\n"
+			"        LOAD    K\n"
+			"        MULT    K2\n"
+			"        ADD     KB\n"
+			"        STORE   D\n"
+			"        B       D\n"
+			"K       DC      1401\n"
+			"K2      DC      100\n"
+			"KB      DC      5\n"
+			"D       DS      1\n"
+			"        HALT\n"
+			"        END\n");
+		unique_ptr<emulator> emul(new emulator);
+		emul->LoadImage(image);
+		vector<int> outputs;
+		Check(emul->RunBatch({}, outputs) == RS_Error && emul->GetErrorMessage().find("Illegal opcode at location 108 : 14") != string::npos,
+			"a classic program stops at an extended opcode: " + emul->GetErrorMessage());
+		emul->EnableExtended(true);
+		Check(emul->RunBatch({}, outputs) == RS_Halted, "the extended opcode runs with the extended instruction set");
+	}
+
+	// Copies within the paged memory match memmove, across pages and overlapping.
+	void TestPagedCopy()
+	{
+		const int kSize = 5 * PagedMemory::kPageSize;
+		mt19937 random(2);
+		for (int trial = 0; trial < 300; ++trial) {
+			PagedMemory memory(kSize);
+			vector<int> expected(kSize, 0);
+			for (int i = 0; i < 200; ++i) {
+				int loc = int(random() % kSize);
+				memory.Store(loc, int(random()));
+				expected[loc] = memory.Load(loc);
+			}
+			int count = int(random() % (2 * PagedMemory::kPageSize));
+			int from = int(random() % (kSize - count));
+			int to = trial % 3 == 0 ? int(random() % (kSize - count))
+				: max(0, min(kSize - count, from + int(random() % 200) - 100));
+			memory.Copy(to, from, count);
+			memmove(expected.data() + to, expected.data() + from, count * sizeof(int));
+			bool same = true;
+			for (int loc = 0; loc < kSize; ++loc) same = same && memory.Load(loc) == expected[loc];
+			Check(same, "copy of " + to_string(count) + " words from " + to_string(from) + " to " + to_string(to));
+		}
+	}
+}
+
+const TestSuite kSuite("extended instruction set", { TestExtendedOpcodes, TestPagedCopy });
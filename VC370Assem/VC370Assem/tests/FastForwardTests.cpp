@@ -0,0 +1,91 @@
+//
+//		Tests of the loop fast forward and the watchdog it must not get around.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "Emulator.h"
+#include "FastForward.h"
+#include <climits>
+#include <memory>
+
+namespace {
+
+	// A loop that is never left.
+	const char *const kEndless =
+		"        ORG     100\n"
+		"LOOP    LOAD    ONE\n"
+		"        BZ      OUT\n"
+		"        B       LOOP\n"
+		"OUT     HALT\n"
+		"ONE     DC      1\n"
+		"        END\n";
+
+	// A loop that adds 2 to S N times.
+	const char *const kCounted =
+		"        ORG     100\n"
+		"        READ    N\n"
+		"LOOP    LOAD    N\n"
+		"        SUB     ONE\n"
+		"        STORE   N\n"
+		"        LOAD    S\n"
+		"        ADD     TWO\n"
+		"        STORE   S\n"
+		"        LOAD    N\n"
+		"        BP      LOOP\n"
+		"        WRITE   S\n"
+		"        HALT\n"
+		"N       DS      1\n"
+		"S       DC      0\n"
+		"ONE     DC      1\n"
+		"TWO     DC      2\n"
+		"        END\n";
+
+	// A loop that is never left is not fast forwarded, so the watchdog stops it with the
+	// counts of the iterations actually run.
+	void TestEndlessLoopUnderLimits()
+	{
+		unique_ptr<emulator> emul(new emulator);
+		emul->LoadImage(Assemble(kEndless));
+		vector<int> outputs;
+
+		RunLimits limits;
+		limits.maxSteps = 3'000'000;
+		emul->SetLimits(limits);
+		Check(emul->RunBatch({}, outputs) == RS_StepLimit, "an endless loop stops at the step limit");
+		Check(emul->GetStepCount() == limits.maxSteps, "the step limit stops it after the limit");
+		Check(emul->GetFastForwardSteps() == 0, "an endless loop is not fast forwarded");
+		Check(emul->GetErrorMessage().find("Hottest loop: 100-102 (1000000 iterations)") != string::npos,
+			"the step limit reports the endless loop: " + emul->GetErrorMessage());
+
+		limits = RunLimits();
+		limits.maxMillis = 100;
+		emul->SetLimits(limits);
+		Check(emul->RunBatch({}, outputs) == RS_TimeLimit, "an endless loop stops at the time limit");
+		Check(emul->GetStepCount() < 1'000'000'000'000LL, "the time limit reports the instructions run");
+		Check(emul->GetErrorMessage().find("Hottest loop: 100-102") != string::npos,
+			"the time limit reports the endless loop: " + emul->GetErrorMessage());
+
+		int memory[VC370Constants::kMaxMemory] = {};
+		memory[100] = VC370Constants::OP_B * VC370Constants::kMaxMemory + 100;
+		int accum = 0;
+		LoopFastForward runner;
+		Check(runner.Run(memory, VC370Constants::kMaxMemory, 100, 100, accum, LLONG_MAX / 2) == 0,
+			"a loop without an exit is not run by the fast forward");
+	}
+
+	// A counted loop is still fast forwarded under a time limit.
+	void TestCountedLoopUnderTimeLimit()
+	{
+		unique_ptr<emulator> emul(new emulator);
+		emul->LoadImage(Assemble(kCounted));
+		RunLimits limits;
+		limits.maxMillis = 60'000;
+		emul->SetLimits(limits);
+		vector<int> outputs;
+		Check(emul->RunBatch({ 2'000'000'000 }, outputs) == RS_Halted, "a counted loop halts under a time limit");
+		Check(outputs == vector<int>{ int(uint32_t(4'000'000'000u)) }, "the counted loop writes its sum");
+		Check(emul->GetFastForwardSteps() > 15'000'000'000LL, "the counted loop is fast forwarded under a time limit");
+	}
+}
+
+const TestSuite kSuite("loop fast forward", { TestEndlessLoopUnderLimits, TestCountedLoopUnderTimeLimit });
@@ -0,0 +1,50 @@
+//
+//		Tests of the incremental assembler of --watch.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "Assembler.h"
+#include "Incremental.h"
+#include <random>
+#include <set>
+
+namespace {
+
+	// Random edits of a source are assembled incrementally as the batch assembler does.
+	void TestIncrementalMatchesBatch()
+	{
+		const vector<string> pool = {
+			"      org   100", "start read  n", "      load  n", "loop  sub   one", "      bp    loop", "      bz    done",
+			"      write n", "done  halt", "n     ds    1", "one   dc    1", "two   dc    2", "      add   two", "x     ds    3",
+			"      store x", "loop  add   one", "      end", "; comment", "", "bad   foo   1", "      load  zz", "zz    dc    7",
+			"      b     start", "      org   5", "      dc    99999", "LOAD  dc    1" };
+		vector<string> lines = { "      org   100", "start read  n", "loop  sub   one", "      bp    loop", "      write n",
+			"      halt", "n     ds    1", "one   dc    1", "      end" };
+		mt19937 random(1);
+		IncrementalAssembler incremental(VC370Constants::kMaxMemory, false);
+		for (int edit = 0; edit < 500; ++edit) {
+			size_t at = random() % (lines.size() + 1);
+			switch (random() % 3) {
+				case 0: lines.insert(lines.begin() + at, pool[random() % pool.size()]); break;
+				case 1: if (at < lines.size()) lines.erase(lines.begin() + at); break;
+				default: if (at < lines.size()) lines[at] = pool[random() % pool.size()]; break;
+			}
+			if (lines.size() > 40) lines.resize(20);
+			string source;
+			for (const string &line : lines) source += line + "\n";
+
+			ProgramImage batch;
+			vector<string> errors;
+			bool ok = Assembler::AssembleText(source, batch, errors);
+			bool incrementalOk = incremental.Update(source);
+			set<string> batchErrors(errors.begin(), errors.end());
+			set<string> incrementalErrors(incremental.GetErrors().begin(), incremental.GetErrors().end());
+			bool same = ok == incrementalOk && batchErrors == incrementalErrors
+				&& (!ok || (batch.Hash() == incremental.GetImage().Hash() && batch.GetSymbols() == incremental.GetImage().GetSymbols()));
+			Check(same, "edit " + to_string(edit) + " is assembled incrementally as in a batch:\n" + source);
+			if (!same) return;
+		}
+	}
+}
+
+const TestSuite kSuite("incremental assembly", { TestIncrementalMatchesBatch });
@@ -0,0 +1,41 @@
+//
+//		Tests of partial evaluation.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "Emulator.h"
+#include "PartialEvaluator.h"
+#include <memory>
+
+namespace {
+
+	// Storage that runs past the end of memory, after a store to it and before a READ.
+	const char *const kPastMemory =
+		"        ORG     100\n"
+		"        LOAD    ONE\n"
+		"        STORE   X\n"
+		"        READ    N\n"
+		"        WRITE   N\n"
+		"        HALT\n"
+		"N       DS      1\n"
+		"ONE     DC      1\n"
+		"X       DS      20000\n"
+		"        END\n";
+
+	// A program with storage past the end of memory is refused rather than evaluated.
+	void TestStoragePastMemory()
+	{
+		ProgramImage image = Assemble(kPastMemory), evaluated;
+		PartialEvaluator evaluator(10'000'000);
+		Check(!evaluator.Evaluate(image, evaluated), "a program with storage past the end of memory is not evaluated");
+		Check(evaluator.GetRefusal().find("runs past the end of memory") != string::npos,
+			"the refusal says why: " + evaluator.GetRefusal());
+
+		unique_ptr<emulator> emul(new emulator);
+		emul->LoadImage(image);
+		vector<int> outputs;
+		Check(emul->RunBatch({ 3 }, outputs) == RS_Halted && outputs == vector<int>{ 3 }, "the program runs as written");
+	}
+}
+
+const TestSuite kSuite("partial evaluation", { TestStoragePastMemory });
@@ -0,0 +1,56 @@
+//
+//		Tests of the run cache.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "RunCache.h"
+
+namespace {
+
+	const char *const kEcho =
+		"        ORG     100\n"
+		"        READ    N\n"
+		"        WRITE   N\n"
+		"        HALT\n"
+		"N       DS      1\n"
+		"        END\n";
+
+	// A result cached by an unlimited run is not replayed under a limit.
+	void TestRunCacheLimits()
+	{
+		ProgramImage image = Assemble(kEcho);
+		RunCache cache(4, "");
+		RunLimits unlimited, tight;
+		tight.maxSteps = 10;
+		RunResult halted;
+		halted.m_status = RS_Halted;
+		halted.m_steps = 1000;
+		cache.Insert(RunCache::Key(image, { 5 }, unlimited, false), halted);
+
+		RunResult found;
+		Check(cache.Find(RunCache::Key(image, { 5 }, unlimited, false), found) && found.m_steps == 1000, "a run is replayed under the same limits");
+		Check(!cache.Find(RunCache::Key(image, { 5 }, tight, false), found), "a run is not replayed under a tighter step limit");
+		tight = RunLimits();
+		tight.maxMillis = 1;
+		Check(!cache.Find(RunCache::Key(image, { 5 }, tight, false), found), "a run is not replayed under a time limit");
+	}
+
+	// A classic run, in which the extended opcodes are illegal, is not replayed with the
+	// extended instruction set, or the other way round.
+	void TestRunCacheInstructionSet()
+	{
+		ProgramImage image = Assemble(kEcho);
+		RunCache cache(4, "");
+		RunLimits limits;
+		RunResult illegal;
+		illegal.m_status = RS_Error;
+		illegal.m_message = "[Emulation] Illegal opcode at location 104 : 14";
+		cache.Insert(RunCache::Key(image, { 7 }, limits, false), illegal);
+
+		RunResult found;
+		Check(cache.Find(RunCache::Key(image, { 7 }, limits, false), found), "a classic run is replayed in a classic run");
+		Check(!cache.Find(RunCache::Key(image, { 7 }, limits, true), found), "a classic run is not replayed with --extended");
+	}
+}
+
+const TestSuite kSuite("run cache", { TestRunCacheLimits, TestRunCacheInstructionSet });
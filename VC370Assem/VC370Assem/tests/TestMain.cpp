@@ -0,0 +1,54 @@
+//
+//  The runner of the regression tests.
+//
+#include "stdafx.h"
+#include "Tests.h"
+#include "Assembler.h"
+
+namespace {
+	int s_failures = 0;		// Checks that failed.
+}
+
+void Check(bool a_ok, const string &a_what)
+{
+	if (a_ok) return;
+	cout << "FAILED: " << a_what << endl;
+	s_failures++;
+}
+
+ProgramImage Assemble(const string &a_source)
+{
+	ProgramImage image;
+	vector<string> errors;
+	Check(Assembler::AssembleText(a_source, image, errors), "the test program assembles");
+	return image;
+}
+
+TestSuite::TestSuite(const string &a_name, initializer_list<Test> a_tests)
+	: m_name(a_name), m_tests(a_tests)
+{
+	Suites().push_back(this);
+}
+
+int TestSuite::RunAll()
+{
+	for (const TestSuite *suite : Suites()) {
+		int before = s_failures;
+		for (Test test : suite->m_tests) test();
+		cout << suite->m_name << ": " << (s_failures == before ? "passed" : to_string(s_failures - before) + " checks failed") << endl;
+	}
+	return s_failures;
+}
+
+vector<const TestSuite *> &TestSuite::Suites()
+{
+	static vector<const TestSuite *> suites;
+	return suites;
+}
+
+int main()
+{
+	int failures = TestSuite::RunAll();
+	cout << (failures == 0 ? "All tests passed." : to_string(failures) + " checks failed.") << endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+//
+//		Regression tests - each file of tests registers its tests with a TestSuite, and
+//		make test runs them all.  A check that fails is displayed, and the run then
+//		exits with status 1.
+//
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include "ProgramImage.h"
+using namespace std;
+
+// Records a failed check unless a_ok.
+void Check(bool a_ok, const string &a_what);
+
+// The image of a source that must assemble.
+ProgramImage Assemble(const string &a_source);
+
+// The tests of a file.  Defined at namespace scope, so that they are registered before
+// main runs them.
+class TestSuite {
+
+public:
+
+	typedef void (*Test)();
+
+	TestSuite(const string &a_name, initializer_list<Test> a_tests);
+
+	// Runs the tests of every suite.  Returns the number of failed checks.
+	static int RunAll();
+
+private:
+
+	static vector<const TestSuite *> &Suites();
+
+	string m_name;
+	vector<Test> m_tests;
+};